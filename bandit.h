@@ -0,0 +1,108 @@
+/*
+ * contextual bandit over the multiplicative decrease factor
+ *
+ * At a loss the flow's context (loss interval in RTTs, cwnd) picks a
+ * row, and an arm of that row picks beta: one BANDIT_STEP below the
+ * flow's beta, the beta itself, or one step above. At the next loss the
+ * arm is paid the goodput of the epoch in between, relative to the rate
+ * before the decrease (1 << BANDIT_REWARD_SHIFT = as fast as before).
+ * A deep back-off pays with a slow epoch, a shallow one with an early
+ * loss or an RTO, which pays nothing.
+ *
+ * The arms keep an EWMA of their reward, so a path that changes is
+ * followed, and are picked by UCB: mean + BANDIT_UCB / sqrt(pulls),
+ * with the square root taken from fls(), so there is no divide.
+ */
+#ifndef _BANDIT_H
+#define _BANDIT_H
+
+#define BANDIT_ARMS 3
+#define BANDIT_STEP 102          /* beta between two arms, 1/1024 */
+#define BANDIT_BETA_MIN 512
+#define BANDIT_BETA_MAX 973      /* 0.95, some decrease is left */
+#define BANDIT_CTX_RTTS 4        /* loss interval buckets */
+#define BANDIT_CTX_CWND 4        /* cwnd buckets */
+#define BANDIT_CTX (BANDIT_CTX_RTTS * BANDIT_CTX_CWND)
+#define BANDIT_REWARD_SHIFT 10
+#define BANDIT_REWARD_MAX (2 << BANDIT_REWARD_SHIFT)
+#define BANDIT_EWMA 3
+#define BANDIT_UCB (1 << (BANDIT_REWARD_SHIFT - 2))
+#define BANDIT_PULLS_MAX 0xffff
+
+struct beta_bandit {
+    u16 pulls[BANDIT_CTX][BANDIT_ARMS];
+    u16 reward[BANDIT_CTX][BANDIT_ARMS]; /* EWMA, << BANDIT_REWARD_SHIFT */
+};
+
+static inline u32 bandit_bucket(int lg, int n)
+{
+    if (lg < 0)
+        return 0;
+    return lg >= n ? n - 1 : lg;
+}
+
+/*
+ * loss interval under 4, 16, 64 or more RTTs times cwnd under 16, 64,
+ * 256 or more packets, both by powers of 4. srtt is << 3 as in tcp_sock.
+ */
+static inline u32 bandit_context(u32 elapsed, u32 srtt, u32 cwnd)
+{
+    u32 rtts, wnd;
+
+    if (elapsed > 0x1fffffff)
+        elapsed = 0x1fffffff;
+    rtts = bandit_bucket((fls(elapsed << 3) - fls(srtt) - 1) >> 1, BANDIT_CTX_RTTS);
+    wnd = bandit_bucket((fls(cwnd) - 4) >> 1, BANDIT_CTX_CWND);
+    return rtts * BANDIT_CTX_CWND + wnd;
+}
+
+/* the arm to play in ctx, an arm never played first */
+static inline u32 bandit_select(const struct beta_bandit *b, u32 ctx)
+{
+    u32 arm, best = BANDIT_ARMS / 2, score, best_score = 0;
+
+    for (arm = 0; arm < BANDIT_ARMS; arm++) {
+        /* the middle arm, the flow's own beta, is tried first */
+        u32 a = (arm + BANDIT_ARMS / 2) % BANDIT_ARMS;
+
+        if (!b->pulls[ctx][a])
+            return a;
+        score = b->reward[ctx][a] + (BANDIT_UCB >> (fls(b->pulls[ctx][a]) >> 1));
+        if (score > best_score) {
+            best_score = score;
+            best = a;
+        }
+    }
+    return best;
+}
+
+static inline void bandit_update(struct beta_bandit *b, u32 ctx, u32 arm, u32 reward)
+{
+    u32 r = b->reward[ctx][arm];
+
+    if (reward > BANDIT_REWARD_MAX)
+        reward = BANDIT_REWARD_MAX;
+    if (!b->pulls[ctx][arm])
+        r = reward;
+    else if (reward > r)
+        r += (reward - r) >> BANDIT_EWMA;
+    else
+        r -= (r - reward) >> BANDIT_EWMA;
+    b->reward[ctx][arm] = r;
+    if (b->pulls[ctx][arm] < BANDIT_PULLS_MAX)
+        b->pulls[ctx][arm]++;
+}
+
+/* beta of an arm around the flow's own */
+static inline u32 bandit_beta(u32 beta, u32 arm)
+{
+    s32 v = (s32)beta + ((s32)arm - BANDIT_ARMS / 2) * BANDIT_STEP;
+
+    if (v < BANDIT_BETA_MIN)
+        return BANDIT_BETA_MIN;
+    if (v > BANDIT_BETA_MAX)
+        return BANDIT_BETA_MAX;
+    return v;
+}
+
+#endif /* _BANDIT_H */
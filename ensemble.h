@@ -0,0 +1,100 @@
+/*
+ * weighted vote of cheap predictors, per flow
+ *
+ * Three experts predict each loss: the shared perceptron, the flow's
+ * markov.h counters and an EWMA of the flow's labels. Each has a
+ * per-flow weight of 2^(-penalty / 2) and the prediction is the
+ * weighted mean of their outputs. An expert that gets the label wrong
+ * has its penalty raised by one (its weight divided by sqrt(2), the
+ * multiplicative weights rule), and the penalties are shifted so that
+ * the best one stays 0. A flow thereby follows whichever expert has
+ * been right about it lately, a wrong perceptron on six samples soon
+ * stops counting.
+ *
+ * The votes are kept from predict to observe, where the label is known,
+ * so the experts run once per loss. Counting on top of them is a few
+ * adds, shifts and one divide.
+ */
+#ifndef _ENSEMBLE_H
+#define _ENSEMBLE_H
+
+#include "perceptron.h"
+#include "markov.h"
+
+#define ENSEMBLE_EXPERTS     3  /* perceptron, markov, ewma */
+#define ENSEMBLE_PENALTY_MAX 32 /* weight 2^-16, as good as gone */
+#define ENSEMBLE_EWMA_SHIFT  3
+#define ENSEMBLE_VOTED       (1 << ENSEMBLE_EXPERTS)
+
+enum {
+    ENSEMBLE_PERCEPTRON,
+    ENSEMBLE_MARKOV,
+    ENSEMBLE_EWMA,
+};
+
+struct ensemble_flow {
+    struct markov_flow markov;
+    u16 ewma;                       /* of the labels, in 1/2^GAMMA */
+    u8  penalty[ENSEMBLE_EXPERTS];
+    u8  votes;                      /* bit i: expert i said 1, ENSEMBLE_VOTED if predicted */
+};
+
+/* 2^(-penalty / 2) in 1/2^16, the odd steps from 2^16 / sqrt(2) */
+static inline u32 ensemble_weight(u8 penalty)
+{
+    return (penalty & 1 ? 46341U : 65536U) >> (penalty >> 1);
+}
+
+/* y[] are the experts' outputs in [0, 1 << GAMMA] */
+static inline s64 ensemble_vote(struct ensemble_flow *f, const s64 *y)
+{
+    u32 w, sum = 0, wsum = 0;
+    int i;
+
+    f->votes = ENSEMBLE_VOTED;
+    for (i = 0; i < ENSEMBLE_EXPERTS; i++) {
+        if (y[i] >= 1 << (GAMMA - 1))
+            f->votes |= 1 << i;
+        /* both in 1/2^16, a y in 1/2^12 keeps three products within u32 */
+        w = ensemble_weight(f->penalty[i]);
+        sum += w * (u32)(y[i] >> 4);
+        wsum += w;
+    }
+    return (s64)(sum / wsum) << 4;
+}
+
+static inline s64 ensemble_predict(struct ensemble_flow *f, struct perceptron_param *p,
+                                   u32 elapsed, u32 srtt, u32 cwnd)
+{
+    s64 y[ENSEMBLE_EXPERTS];
+
+    y[ENSEMBLE_PERCEPTRON] = get_prediction(p, elapsed, srtt, cwnd);
+    y[ENSEMBLE_MARKOV] = markov_predict(&f->markov);
+    y[ENSEMBLE_EWMA] = f->ewma;
+    return ensemble_vote(f, y);
+}
+
+/* score the votes of the last predict, then let the flow's experts learn */
+static inline void ensemble_update(struct ensemble_flow *f, u32 label)
+{
+    u8 best = ENSEMBLE_PENALTY_MAX;
+    int i;
+
+    label = !!label;
+    if (f->votes & ENSEMBLE_VOTED) {
+        for (i = 0; i < ENSEMBLE_EXPERTS; i++) {
+            if (((f->votes >> i) & 1) != label && f->penalty[i] < ENSEMBLE_PENALTY_MAX)
+                f->penalty[i]++;
+            if (f->penalty[i] < best)
+                best = f->penalty[i];
+        }
+        for (i = 0; i < ENSEMBLE_EXPERTS; i++)
+            f->penalty[i] -= best;
+    }
+    f->votes = 0;
+    markov_update(&f->markov, label);
+    /* a u16 stops short of 1 << GAMMA, no matter for a threshold */
+    f->ewma += ((label ? 0xffff : 0) - (s32)f->ewma) >> ENSEMBLE_EWMA_SHIFT;
+}
+
+#endif /* _ENSEMBLE_H */
@@ -0,0 +1,100 @@
+/*
+ * fixed-point primitives shared by inference and training
+ *
+ * Nothing here does a 64-bit division, which is a __divdi3 call on
+ * 32-bit kernels.
+ */
+#ifndef _FIXP_H
+#define _FIXP_H
+
+#define FIXP_ONE(shift)  (1LL << (shift))
+#define FIXP_HALF(shift) (1LL << ((shift) - 1))
+
+#define FIXP_S64_MAX ((s64)(~0ULL >> 1))
+#define FIXP_S64_MIN (-FIXP_S64_MAX - 1)
+
+/* x / 2^shift rounded toward zero, the same result as a signed divide */
+static inline s64 fixp_div_pow2(s64 x, int shift)
+{
+    return (x + ((x >> 63) & (FIXP_ONE(shift) - 1))) >> shift;
+}
+
+/*
+ * division by a runtime constant d >= 2: compute r = fixp_recip(d) once,
+ * then fixp_mul_recip(x, r) is x / d rounded toward minus infinity
+ * (and at most 1 more than that for |x| >= 2^32 / d)
+ */
+static inline u32 fixp_recip(u32 d)
+{
+    return 0xffffffffU / d + 1;
+}
+
+static inline s32 fixp_mul_recip(s32 x, u32 r)
+{
+    /*
+     * r is 2^32 / d rounded up, which only floors x >= 0 right: a
+     * negative multiple of d would come out one too low. For x < 0,
+     * floor(x / d) = -1 - floor((-1 - x) / d).
+     */
+    if (x < 0)
+        return -1 - (s32)(((u64)(-1 - x) * r) >> 32);
+    return (s32)(((u64)x * r) >> 32);
+}
+
+static inline s64 fixp_clamp(s64 x, s64 limit)
+{
+    if (x > limit)
+        return limit;
+    if (x < -limit)
+        return -limit;
+    return x;
+}
+
+static inline s64 fixp_add_sat(s64 a, s64 b)
+{
+    s64 r = (s64)((u64)a + (u64)b);
+
+    /* overflow iff both operands have the sign the result lacks */
+    if (((a ^ r) & (b ^ r)) < 0)
+        return a < 0 ? FIXP_S64_MIN : FIXP_S64_MAX;
+    return r;
+}
+
+/*
+ * acc + a * b, saturating the sum. The product itself must fit in s64,
+ * which the callers guarantee by bounding one of the factors (see
+ * PERCEPTRON_W_MAX).
+ */
+static inline s64 fixp_mac_sat(s64 acc, s64 a, s64 b)
+{
+    return fixp_add_sat(acc, a * b);
+}
+
+/*
+ * u32 in a u16, for the per-flow history
+ * a small unsigned float: 5 bit exponent, 11 bit mantissa with an
+ * implicit leading one. Values below 2^12 are exact, larger ones keep
+ * 12 significant bits (rounded down, < 0.05% off) up to 2^32 - 1.
+ * Codes sort like the values they stand for.
+ */
+#define FIXP_U16F_MANT 11
+
+static inline u16 fixp_u16f_encode(u32 x)
+{
+    int e = fls(x) - FIXP_U16F_MANT;
+
+    if (e <= 0)
+        return x;
+    return (e << FIXP_U16F_MANT) + (x >> (e - 1)) - (1 << FIXP_U16F_MANT);
+}
+
+static inline u32 fixp_u16f_decode(u16 c)
+{
+    int e = c >> FIXP_U16F_MANT;
+
+    if (!e)
+        return c;
+    return ((c & ((1 << FIXP_U16F_MANT) - 1)) | (1U << FIXP_U16F_MANT)) << (e - 1);
+}
+
+#endif /* _FIXP_H */
@@ -0,0 +1,95 @@
+/*
+ * Holt's double exponential smoothing of a flow's losses
+ *
+ * Two series, the cwnd at each loss and the time between losses, each
+ * with a level and a trend:
+ *
+ *   forecast = level + trend
+ *   level   += (z - forecast) / 2^HOLT_LEVEL_SHIFT + trend
+ *   trend   += (level - level before - trend) / 2^HOLT_TREND_SHIFT
+ *
+ * so a Wmax that keeps creeping up, or losses that keep coming sooner,
+ * are extrapolated one loss ahead instead of averaged. The series are
+ * smoothed as fixp_u16f codes of the value << HOLT_FRAC: exact to
+ * 1/2^HOLT_FRAC below 128, relative to 1/2^11 above, where the trend
+ * becomes a growth ratio. A loss costs two encodes and a few adds and
+ * shifts, and the state is 8 bytes.
+ */
+#ifndef _HOLT_H
+#define _HOLT_H
+
+#include "fixp.h"
+#include "perceptron.h"
+
+#define HOLT_FRAC        4
+#define HOLT_LEVEL_SHIFT 3
+#define HOLT_TREND_SHIFT 3
+#define HOLT_MAX         ((1U << (32 - HOLT_FRAC)) - 1)
+
+struct holt {
+    u16 cwnd;           /* level, 0 before the first loss */
+    u16 interval;       /* level, 0 before the second loss */
+    s16 cwnd_trend;     /* code steps per loss */
+    s16 interval_trend;
+};
+
+static inline s32 holt_clamp(s32 v, s32 lo, s32 hi)
+{
+    return v < lo ? lo : v > hi ? hi : v;
+}
+
+static inline u16 holt_encode(u32 x)
+{
+    return fixp_u16f_encode((x > HOLT_MAX ? HOLT_MAX : x) << HOLT_FRAC);
+}
+
+static inline u32 holt_decode(s32 c)
+{
+    return c <= 0 ? 0 : fixp_u16f_decode(holt_clamp(c, 0, 0xffff)) >> HOLT_FRAC;
+}
+
+static inline void holt_step(u16 *level, s16 *trend, u16 z)
+{
+    s32 prev = *level, l, t;
+
+    l = prev + *trend + (((s32)z - prev - *trend) >> HOLT_LEVEL_SHIFT);
+    l = holt_clamp(l, 1, 0xffff);
+    t = *trend + ((l - prev - *trend) >> HOLT_TREND_SHIFT);
+    *trend = holt_clamp(t, -0x8000, 0x7fff);
+    *level = l;
+}
+
+/*
+ * the loss of a flow at cwnd, elapsed jiffies after its previous one;
+ * the first loss has no previous one, its elapsed is not used
+ */
+static inline void holt_update(struct holt *h, u32 cwnd, u32 elapsed)
+{
+    u16 c = holt_encode(cwnd);
+
+    if (!h->cwnd) {
+        h->cwnd = c ? c : 1;
+        return;
+    }
+    holt_step(&h->cwnd, &h->cwnd_trend, c);
+    if (!h->interval)
+        h->interval = holt_clamp(holt_encode(elapsed), 1, 0xffff);
+    else
+        holt_step(&h->interval, &h->interval_trend, holt_encode(elapsed));
+}
+
+/* the cwnd of the next loss, see wmax_clamp() */
+static inline u32 holt_wmax(const struct holt *h, u32 cwnd)
+{
+    return wmax_clamp(holt_decode((s32)h->cwnd + h->cwnd_trend), cwnd);
+}
+
+/* jiffies from the last loss to the next, 0 if not known yet */
+static inline u32 holt_interval(const struct holt *h)
+{
+    if (!h->interval)
+        return 0;
+    return holt_decode((s32)h->interval + h->interval_trend);
+}
+
+#endif /* _HOLT_H */
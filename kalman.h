@@ -0,0 +1,104 @@
+/*
+ * scalar Kalman filter of a flow's saturation cwnd (Wmax)
+ *
+ * The state is Wmax itself, a random walk that may move by about
+ * 1/2^KALMAN_Q_SHIFT of its value, or of the loss's cwnd if that is
+ * larger, and by at least a packet between two losses (process noise Q).
+ * Each loss measures it as snd_cwnd with noise R, and R follows the
+ * innovations: an EWMA of (z - x)^2 - P. On a quiet path R stays small
+ * and the estimate follows the losses, on a noisy one it averages them.
+ * P is the variance of the estimate, its square root is how far off
+ * Wmax may be, in packets.
+ *
+ * A loss costs one 32-bit divide for the gain and a few multiplies.
+ * P and R are kept as fixp_u16f codes so the state is 8 bytes.
+ */
+#ifndef _KALMAN_H
+#define _KALMAN_H
+
+#include "fixp.h"
+#include "perceptron.h"
+
+#define KALMAN_FRAC    4  /* bits of x below a packet */
+#define KALMAN_Q_SHIFT 4
+#define KALMAN_R_EWMA  3
+#define KALMAN_K_SHIFT 8  /* gain in 1/256 */
+#define KALMAN_X_MAX   ((1U << 31) - 1) /* x and z << KALMAN_FRAC fit s32 */
+
+struct wmax_kalman {
+    u32 x;  /* Wmax << KALMAN_FRAC, 0 before the first loss */
+    u16 p;  /* variance of x, packets^2, fixp_u16f */
+    u16 r;  /* variance of a loss's cwnd around Wmax, same units */
+};
+
+static inline u32 kalman_sq(u32 v)
+{
+    return v > 0xffff ? 0xffffffffU : v * v;
+}
+
+static inline void kalman_update(struct wmax_kalman *k, u32 z)
+{
+    u32 p, r, q, e2, s, gain;
+    s32 innov;
+    int shift;
+
+    if (z > KALMAN_X_MAX >> KALMAN_FRAC)
+        z = KALMAN_X_MAX >> KALMAN_FRAC;
+    if (!k->x) {
+        /* no idea yet: anywhere within half of the first loss */
+        k->x = z << KALMAN_FRAC;
+        k->p = fixp_u16f_encode(kalman_sq(z >> 1));
+        k->r = fixp_u16f_encode(kalman_sq(z >> 3));
+        return;
+    }
+
+    /*
+     * predict; with Q (and P) 0 the gain would stay 0 and x could never
+     * leave a small first Wmax, whatever the losses say
+     */
+    q = kalman_sq((z > k->x >> KALMAN_FRAC ? z : k->x >> KALMAN_FRAC) >> KALMAN_Q_SHIFT);
+    if (!q)
+        q = 1;
+    p = fixp_u16f_decode(k->p);
+    p = p + q < p ? 0xffffffffU : p + q;
+
+    /* adapt R to the innovation */
+    innov = (s32)(z << KALMAN_FRAC) - (s32)k->x;
+    e2 = kalman_sq(abs(innov) >> KALMAN_FRAC);
+    r = fixp_u16f_decode(k->r);
+    e2 = e2 > p ? e2 - p : 0;
+    if (e2 > r)
+        r += (e2 - r) >> KALMAN_R_EWMA;
+    else
+        r -= (r - e2) >> KALMAN_R_EWMA;
+    if (!r)
+        r = 1;
+
+    /* correct, K = P / (P + R) */
+    s = p + r < p ? 0xffffffffU : p + r;
+    shift = fls(s) - 24;
+    if (shift > 0)
+        gain = ((p >> shift) << KALMAN_K_SHIFT) / (s >> shift);
+    else
+        gain = (p << KALMAN_K_SHIFT) / s;
+    k->x += (s32)(((s64)innov * gain) >> KALMAN_K_SHIFT);
+    if (!k->x)
+        k->x = 1;
+    p = ((u64)p * ((1 << KALMAN_K_SHIFT) - gain)) >> KALMAN_K_SHIFT;
+    k->p = fixp_u16f_encode(p ? p : 1);
+    k->r = fixp_u16f_encode(r);
+}
+
+/* the estimate, see wmax_clamp() */
+static inline u32 kalman_wmax(const struct wmax_kalman *k, u32 cwnd)
+{
+    return wmax_clamp(k->x >> KALMAN_FRAC, cwnd);
+}
+
+/* standard deviation of the estimate, packets */
+static inline u32 kalman_sd(const struct wmax_kalman *k)
+{
+    return int_sqrt(fixp_u16f_decode(k->p));
+}
+
+#endif /* _KALMAN_H */
@@ -0,0 +1,68 @@
+/*
+ * k-nearest-neighbour predictor over the flow's loss history
+ *
+ * The HIS_LEN entries of the history ring are the training set: the
+ * prediction is the mean target of the KNN_K entries closest to the
+ * loss being handled. Nothing is learned, so there is no train() on
+ * the loss path at all.
+ *
+ * The distance is the L1 distance of the fixp_u16f codes the ring
+ * already keeps. The codes are close to a log scale (2^11 apart is a
+ * factor of 2), so each feature counts by its ratio and none swamps
+ * the others: no normalizer and no multiply. Ties go to the newer
+ * entry.
+ */
+#ifndef _KNN_H
+#define _KNN_H
+
+#include "tcp_pred.h"
+#include "fixp.h"
+
+#define KNN_K 3
+
+static inline u32 knn_dist(u16 a, u16 b)
+{
+    return a > b ? a - b : b - a;
+}
+
+/*
+ * the ring is elapsed/rtt/cwnd/target with its newest entry at newest,
+ * entries whose target is TCP_PRED_NO_TARGET are skipped
+ */
+static inline u32 knn_predict(const u16 *elapsed, const u16 *rtt, const u16 *cwnd,
+                              const s64 *target, int newest,
+                              u32 x_elapsed, u32 x_srtt, u32 x_cwnd)
+{
+    u32 best[KNN_K], best_t[KNN_K];
+    u16 e = fixp_u16f_encode(x_elapsed);
+    u16 r = fixp_u16f_encode(x_srtt);
+    u16 c = fixp_u16f_encode(x_cwnd);
+    u32 d, sum = 0;
+    int i, j, k, n = 0;
+
+    /* newest first, so that a tie keeps the newer entry */
+    for (k = 0; k < HIS_LEN; k++) {
+        i = (newest + HIS_LEN - k) % HIS_LEN;
+        if (target[i] < 0)
+            continue;
+        d = knn_dist(elapsed[i], e) + knn_dist(rtt[i], r) + knn_dist(cwnd[i], c);
+        /* insertion into the sorted best[] */
+        for (j = n < KNN_K ? n++ : KNN_K; j > 0 && best[j - 1] > d; j--) {
+            if (j < KNN_K) {
+                best[j] = best[j - 1];
+                best_t[j] = best_t[j - 1];
+            }
+        }
+        if (j < KNN_K) {
+            best[j] = d;
+            best_t[j] = target[i];
+        }
+    }
+    if (!n)
+        return 1 << (TCP_PRED_ONE_SHIFT - 1);
+    for (j = 0; j < n; j++)
+        sum += best_t[j];
+    return sum / n;
+}
+
+#endif /* _KNN_H */
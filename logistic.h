@@ -0,0 +1,66 @@
+/*
+ * logistic regression over the three loss features
+ *
+ * One output unit on the normalized inputs of perceptron.h, through the
+ * same sigmoid[] table as the perceptron's hidden layer. It learns
+ * online: every loss is predicted first and then taken as one SGD step
+ * on the log loss, w += (label - y) * x / 2^LOGISTIC_ETA. No epochs, no
+ * history and the weights are never reinitialized.
+ */
+#ifndef _LOGISTIC_H
+#define _LOGISTIC_H
+
+#include "perceptron.h"
+
+#define LOGISTIC_ETA 3
+
+struct logistic_param {
+    s64 w[L + 1]; /* w[L] is the threshold, 1 << DELTA units as wlm */
+    struct perceptron_norm norm;
+};
+
+static inline void logistic_inputs(const struct logistic_param *lr, s64 *x,
+                                   u32 elapsed, u32 srtt, u32 cwnd)
+{
+    x[0] = norm_input(&lr->norm, 0, elapsed);
+    x[1] = norm_input(&lr->norm, 1, srtt);
+    x[2] = norm_input(&lr->norm, 2, cwnd);
+}
+
+static inline s64 logistic_output(const struct logistic_param *lr, const s64 *x)
+{
+    s64 z = 0;
+    int i;
+
+    for (i = 0; i < L; i++)
+        z = fixp_mac_sat(z, lr->w[i], x[i]);
+    z = fixp_add_sat(z, -lr->w[L]);
+    return sigmoid_lookup(fixp_div_pow2(z >> (1 + DELTA - ALPHA), BETA_SHIFT)
+                          + FIXP_HALF(ALPHA));
+}
+
+static inline s64 logistic_predict(const struct logistic_param *lr,
+                                   u32 elapsed, u32 srtt, u32 cwnd)
+{
+    s64 x[L];
+
+    logistic_inputs(lr, x, elapsed, srtt, cwnd);
+    return logistic_output(lr, x);
+}
+
+/* learn one loss, then let it into the normalizer */
+static inline void logistic_update(struct logistic_param *lr, u32 elapsed, u32 srtt,
+                                   u32 cwnd, u32 label)
+{
+    s64 x[L], err;
+    int i;
+
+    logistic_inputs(lr, x, elapsed, srtt, cwnd);
+    err = ((s64)!!label << GAMMA) - logistic_output(lr, x);
+    for (i = 0; i < L; i++)
+        lr->w[i] = fixp_clamp(lr->w[i] + ((err * x[i]) >> LOGISTIC_ETA), PERCEPTRON_W_MAX);
+    lr->w[L] = fixp_clamp(lr->w[L] - ((err << NORM_SHIFT) >> LOGISTIC_ETA), PERCEPTRON_W_MAX);
+    norm_update(&lr->norm, elapsed, srtt, cwnd);
+}
+
+#endif /* _LOGISTIC_H */
@@ -0,0 +1,54 @@
+/*
+ * order-k Markov predictor of the loss label
+ *
+ * The flow's last MARKOV_ORDER labels pick one of 2^MARKOV_ORDER 2-bit
+ * saturating counters, a counter of 2 or more predicts label 1. A loss
+ * costs a shift, a mask and an increment: no multiply and no training
+ * pass, everything is learned as the labels come in. All of the state
+ * is per flow and fits the model area of struct bictcp.
+ */
+#ifndef _MARKOV_H
+#define _MARKOV_H
+
+#include "tcp_pred.h"
+
+#define MARKOV_ORDER 4
+#define MARKOV_CTX_MASK ((1U << MARKOV_ORDER) - 1)
+/*
+ * a zeroed flow starts every counter at weakly 1, the label a fresh
+ * flow mostly sees (its last_max_cwnd is still the slow start cwnd)
+ */
+#define MARKOV_INIT 2
+
+struct markov_flow {
+    u32 counters; /* 2 bits per context, stored ^ MARKOV_INIT */
+    u8  labels;   /* the last MARKOV_ORDER labels, newest in bit 0 */
+};
+
+static inline u32 markov_counter(const struct markov_flow *f)
+{
+    u32 ctx = f->labels & MARKOV_CTX_MASK;
+
+    return ((f->counters >> (2 * ctx)) & 3) ^ MARKOV_INIT;
+}
+
+/* 1/8, 3/8, 5/8 or 7/8 of 1 << TCP_PRED_ONE_SHIFT */
+static inline u32 markov_predict(const struct markov_flow *f)
+{
+    return (2 * markov_counter(f) + 1) << (TCP_PRED_ONE_SHIFT - 3);
+}
+
+static inline void markov_update(struct markov_flow *f, u32 label)
+{
+    u32 ctx = f->labels & MARKOV_CTX_MASK;
+    u32 c = markov_counter(f);
+
+    if (label && c < 3)
+        c++;
+    else if (!label && c > 0)
+        c--;
+    f->counters = (f->counters & ~(3U << (2 * ctx))) | ((c ^ MARKOV_INIT) << (2 * ctx));
+    f->labels = (f->labels << 1) | !!label;
+}
+
+#endif /* _MARKOV_H */
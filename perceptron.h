@@ -0,0 +1,348 @@
+/*
+ * L-M-N perceptron used by tcp_pred to predict the next loss label
+ *
+ * This file is shared with the userspace tools in tools/, so it must
+ * not call into the kernel. The includer provides s64/u16/u8.
+ */
+#ifndef _PERCEPTRON_H
+#define _PERCEPTRON_H
+
+#include "tcp_pred.h"
+#include "fixp.h"
+#include "sigmoid.h"
+
+#define L 3
+#define M 4
+#define N 1
+#define ETA 1
+#define ALPHA 16
+#define BETA 16
+#define BETA_SHIFT 4 /* log2(BETA) */
+#define GAMMA 16
+#define DELTA 16
+#define LOOP_MAX 10
+
+/*
+ * weights are clamped to +-PERCEPTRON_W_MAX, so with |Lout| <= NORM_CLAMP
+ * and Mout <= 1 << GAMMA no product in get_prediction() or train()
+ * can overflow s64
+ */
+#define PERCEPTRON_W_MAX FIXP_ONE(44)
+
+/*
+ * input normalizer
+ * raw elapsed/srtt/cwnd drive modin far outside the sigmoid table, so
+ * every input goes in as (x - mean) / mad in units of 1/2^NORM_SHIFT,
+ * clamped to +-NORM_CLAMP. mean and mad (mean absolute deviation) are
+ * EWMAs with weight 1/2^NORM_EWMA, kept << NORM_FRAC. Raw inputs
+ * saturate at NORM_X_MAX so that all of this fits s32.
+ */
+#define NORM_SHIFT 2
+#define NORM_CLAMP (4 << NORM_SHIFT)
+#define NORM_EWMA 3
+#define NORM_FRAC 6
+#define NORM_X_MAX ((1 << (29 - NORM_FRAC - NORM_SHIFT)) - 1)
+
+static inline s32 norm_sat(u32 x){
+    return x > NORM_X_MAX ? NORM_X_MAX : x;
+}
+
+struct perceptron_norm{
+    s32 mean[L];
+    s32 mad[L];
+    u32 recip[L]; /* fixp_recip(mad[i]) */
+    u32 samples;
+};
+
+/*parceptron parameters*/
+struct perceptron_param{
+    s64 wlm[L+1][M];
+    s64 wmn[M+1][N];
+    s64 dlm[L+1][M];
+    s64 dmn[M+1][N];
+    s64 Lout[L];
+    s64 Min[M];
+    s64 Mout[M];
+    s64 Nin[N];
+    struct perceptron_norm norm;
+    u32 rng;       /* xorshift32 state, see perceptron_random() */
+};
+
+
+/*
+ * xorshift32
+ * the generator lives in the model, so a model seeded the same way
+ * gives the same weights in the kernel and in tools/
+ */
+static inline u32 perceptron_random(struct perceptron_param *p){
+    u32 x = p->rng;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return p->rng = x;
+}
+
+/*
+ * Xavier/Glorot initialization
+ * get_prediction() feeds the sigmoid sum(w * x) / 2, where x is a
+ * normalized input in 1/2^NORM_SHIFT units for L->M and an output in
+ * [0, 1] for M->N, so the limits are rescaled by 2 / 2^NORM_SHIFT and 2.
+ * The hidden layer gets Glorot's 4x for the logistic sigmoid. The output
+ * layer starts at 1/4 so a new model predicts about 1/2 and the first
+ * epochs go into the readout; with tools/tcp_pred_diff this fits the
+ * training labels in 3 epochs about as well as the old +-1 weights did
+ * in 5. Thresholds start at 0. The square roots are computed offline,
+ * in 1 << DELTA units.
+ */
+#define XAVIER_LM 60675 /* sqrt(6 / (L + M)) */
+#define XAVIER_MN 71791 /* sqrt(6 / (M + N)) */
+#define INIT_LIMIT_LM ((4 * 2 * XAVIER_LM) >> NORM_SHIFT)
+#define INIT_LIMIT_MN ((2 * XAVIER_MN) / 4)
+
+/* uniform in [-limit, limit], multiply-shift instead of a modulo */
+static inline s64 random_weight(struct perceptron_param *p, u32 limit){
+    return (s64)(((u64)perceptron_random(p) * (2 * limit + 1)) >> 32) - limit;
+}
+
+/* once per model lifetime, train() continues from the current weights */
+static void initialize_perceptron(struct perceptron_param *p, u32 seed){
+    int i,j;
+    p->rng = seed ? seed : 2463534242U;
+    for(i=0;i<L+1;i++){
+        for(j=0;j<M;j++){
+            p->wlm[i][j] = i == L ? 0 : random_weight(p, INIT_LIMIT_LM);
+        }
+    }
+    for(i=0;i<M+1;i++){
+        for(j=0;j<N;j++){
+            p->wmn[i][j] = i == M ? 0 : random_weight(p, INIT_LIMIT_MN);
+        }
+    }
+}
+
+static void initialize_edge_delta(struct perceptron_param *p){
+    int i,j;
+    for(i=0;i<L+1;i++){
+        for(j=0;j<M;j++){
+            p->dlm[i][j] = 0;
+        }
+    }
+    for(i=0;i<M+1;i++){
+        for(j=0;j<N;j++){
+            p->dmn[i][j] = 0;
+        }
+    }
+}
+
+/* feed one loss into the running mean/mad of the inputs */
+static void norm_update(struct perceptron_norm *n, u32 elapsed, u32 srtt, u32 cwnd){
+    s32 x[L] = { norm_sat(elapsed), norm_sat(srtt), norm_sat(cwnd) };
+    s32 d;
+    int i;
+
+    for(i=0;i<L;i++){
+        x[i] <<= NORM_FRAC;
+        if(n->samples == 0){
+            n->mean[i] = x[i];
+            n->mad[i] = x[i] / 2;
+        }else{
+            d = x[i] - n->mean[i];
+            n->mean[i] += d >> NORM_EWMA;
+            n->mad[i] += ((d < 0 ? -d : d) - n->mad[i]) >> NORM_EWMA;
+        }
+        //never divide by less than 1 (unnormalized) unit
+        if(n->mad[i] < (1 << NORM_FRAC))
+            n->mad[i] = 1 << NORM_FRAC;
+        n->recip[i] = fixp_recip(n->mad[i]);
+    }
+    n->samples++;
+}
+
+static inline s32 norm_input(const struct perceptron_norm *n, int i, u32 x){
+    s32 z;
+
+    if(n->samples == 0)
+        return 0;
+    z = fixp_mul_recip(((norm_sat(x) << NORM_FRAC) - n->mean[i]) * (1 << NORM_SHIFT),
+                       n->recip[i]);
+    if(z > NORM_CLAMP)
+        return NORM_CLAMP;
+    if(z < -NORM_CLAMP)
+        return -NORM_CLAMP;
+    return z;
+}
+
+/* sigmoid[] over its domain, saturated outside */
+static inline s64 sigmoid_lookup(s64 modin){
+    if(0 <= modin && modin < (1 << ALPHA)){
+        return sigmoid[modin];
+    }else if(modin < 0){
+        return 0;
+    }else{
+        return 1 << GAMMA;
+    }
+}
+
+static s64 get_prediction(struct perceptron_param *p, u32 elapsed, u32 srtt, u32 cwnd){
+    s64 modin;
+    int i,j;
+    //L層の出力としてcaからデータを取る
+    p->Lout[0] = norm_input(&p->norm, 0, elapsed);
+    p->Lout[1] = norm_input(&p->norm, 1, srtt);
+    p->Lout[2] = norm_input(&p->norm, 2, cwnd);
+
+    //M層のi-thノードに対する入力値を計算する
+    for(i=0;i<M;i++){
+        p->Min[i] = 0;
+        //Lout * weightの和を計算
+        for(j=0;j<L;j++){
+            p->Min[i] = fixp_mac_sat(p->Min[i], p->wlm[j][i], p->Lout[j]);
+        }
+        //M層のi番目ノードの閾値分を入力から減算
+        p->Min[i] = fixp_add_sat(p->Min[i], -p->wlm[L][i]);
+    }
+
+    //M層i-thノードのoutputを計算する    
+    for(i=0;i<M;i++){
+        modin = fixp_div_pow2(p->Min[i] >> (1 + DELTA - ALPHA), BETA_SHIFT) + FIXP_HALF(ALPHA);
+        p->Mout[i] = sigmoid_lookup(modin);
+    }
+
+    //N層i-thノードへの入力値を計算する
+    for(i=0;i<N;i++){
+        p->Nin[i] = 0;
+        for(j=0;j<M;j++){
+            //M層output * weightの和を計算
+            p->Nin[i] = fixp_mac_sat(p->Nin[i], p->wmn[j][i], p->Mout[j]);
+        }
+        p->Nin[i] = fixp_add_sat(p->Nin[i], -p->wmn[M][i]);
+    }
+
+    modin = fixp_div_pow2(p->Nin[0] >> (1+GAMMA+DELTA-ALPHA), BETA_SHIFT) + FIXP_HALF(ALPHA);
+    return sigmoid_lookup(modin);
+}
+
+/*
+ * one batch gradient step over the HIS_LEN loss history
+ * the features are fixp_u16f codes, as struct bictcp keeps them,
+ * target[] is the wanted output in [0, 1 << GAMMA], or
+ * TCP_PRED_NO_TARGET for an entry that is not learned
+ */
+static void train_epoch(struct perceptron_param *p, const u16 *elapsed,
+                        const u16 *rtt, const u16 *cwnd, const s64 *target){
+    s64 result, delta_k, delta_j;
+    int i,j,k;
+
+    //差分変数の初期化
+    initialize_edge_delta(p);
+
+    //全ての教師データに対して
+    for(i=0;i<HIS_LEN;i++){
+        if(target[i] < 0)
+            continue;
+        //予測を出す
+        result = get_prediction(p, fixp_u16f_decode(elapsed[i]),
+                                fixp_u16f_decode(rtt[i]), fixp_u16f_decode(cwnd[i]));
+
+        delta_k = target[i] - result;
+        delta_k *= (1 << GAMMA) - result;
+        delta_k >>= GAMMA;
+        delta_k *= result;
+        delta_k >>= GAMMA;
+
+        //M->Nの偏微分値
+        for(j=0;j<M+1;j++){
+            for(k=0;k<N;k++){
+                if(j != M){
+                    p->dmn[j][k] += (((delta_k * p->Mout[j]) >> GAMMA) << DELTA) >> GAMMA;
+                }else{
+                    p->dmn[j][k] += ((delta_k * -1) << DELTA) >> GAMMA;
+                }
+            }
+        }
+
+        //L->Mの偏微分値
+        for(j=0;j<M;j++){
+            delta_j = (delta_k * p->wmn[j][0]) >> DELTA;
+            delta_j *= p->Mout[j];
+            delta_j >>= GAMMA;
+            delta_j *= (1<<GAMMA) - p->Mout[j];
+            delta_j >>= GAMMA;
+            for(k=0;k<L+1;k++){
+                if(k != L){
+                    //Loutは1/2^NORM_SHIFT単位の整数なので閾値と同じスケールにする
+                    p->dlm[k][j] += ((delta_j * p->Lout[k]) << DELTA) >> GAMMA;
+                }else{
+                    p->dlm[k][j] += ((delta_j * -1) << DELTA) >> GAMMA;
+                }
+            }
+        }
+    }
+    for(i=0;i<L+1;i++){
+        for(j=0;j<M;j++){
+            p->wlm[i][j] = fixp_clamp(p->wlm[i][j] + (p->dlm[i][j] >> ETA), PERCEPTRON_W_MAX);
+        }
+    }
+    for(i=0;i<M+1;i++){
+        for(j=0;j<N;j++){
+            p->wmn[i][j] = fixp_clamp(p->wmn[i][j] + (p->dmn[i][j] >> ETA), PERCEPTRON_W_MAX);
+        }
+    }
+}
+
+/*
+ * learn the HIS_LEN loss history (features and targets), starting
+ * from the current weights
+ */
+static void train(struct perceptron_param *p, const u16 *elapsed,
+                  const u16 *rtt, const u16 *cwnd, const s64 *target){
+    int x;
+
+    for(x=0;x<LOOP_MAX;x++){
+        train_epoch(p, elapsed, rtt, cwnd, target);
+    }
+}
+
+/* binary head: the output is the probability of label 1, bit i of answers is label i */
+static inline void label_targets(u8 answers, s64 *target){
+    int i;
+
+    for(i=0;i<HIS_LEN;i++){
+        target[i] = (s64)((answers >> i) & 1) << GAMMA;
+    }
+}
+
+/*
+ * regression head
+ * the output is the next saturation cwnd as a ratio of the cwnd at the
+ * loss, [0, 1 << GAMMA] standing for 0.5 .. 1.5. Both helpers work in
+ * 1/1024 steps with u32 math, which is fine for cwnd < 2^21.
+ */
+#define WMAX_RATIO_SHIFT 10
+
+static inline s64 wmax_target(u32 cwnd, u32 next){
+    if(cwnd == 0 || 2 * next >= 3 * cwnd)
+        return 1 << GAMMA;
+    if(2 * next <= cwnd)
+        return 0;
+    return (s64)((next << WMAX_RATIO_SHIFT) / cwnd - (1 << (WMAX_RATIO_SHIFT - 1)))
+        << (GAMMA - WMAX_RATIO_SHIFT);
+}
+
+static inline u32 wmax_from_prediction(u32 cwnd, s64 prediction){
+    u32 ratio = (prediction >> (GAMMA - WMAX_RATIO_SHIFT)) + (1 << (WMAX_RATIO_SHIFT - 1));
+
+    return (cwnd * ratio) >> WMAX_RATIO_SHIFT;
+}
+
+/* a Wmax from elsewhere (kalman.h, holt.h) within the head's 0.5 .. 1.5 of cwnd */
+static inline u32 wmax_clamp(u32 w, u32 cwnd){
+    if(w < cwnd >> 1)
+        return cwnd >> 1;
+    if(w > cwnd + (cwnd >> 1))
+        return cwnd + (cwnd >> 1);
+    return w;
+}
+
+#endif /* _PERCEPTRON_H */
@@ -0,0 +1,110 @@
+/*
+ * Elman recurrent cell over a flow's sequence of losses
+ *
+ * The perceptron sees one loss at a time. Here every loss also updates
+ * a small hidden state from the loss interval, the cwnd change and the
+ * label, so the cell can follow a periodic pattern of cross traffic.
+ *
+ *   predict  y = sigmoid(wo . h + wxo . x + bo)
+ *   update   h = tanh(wh . h + wx . (x, label) + bh)
+ *
+ * x is the loss interval in RTTs and the cwnd against the previous
+ * loss's, both as log2 / 4 taken from fixp_u16f codes. Everything is
+ * Q12: the weights, the inputs and the RNN_HIDDEN s16s of state kept
+ * per flow. With the weights within +-RNN_W_MAX a sum fits s32. tanh
+ * comes from sigmoid[] as 2 sigmoid(2x) - 1. The update is
+ * O(RNN_HIDDEN^2) multiplies and nothing is learned at run time: the
+ * weights come from tools/tcp_pred_rnn, see rnn_gen.h.
+ */
+#ifndef _RNN_H
+#define _RNN_H
+
+#include "perceptron.h"
+
+#define RNN_HIDDEN 4
+#define RNN_IN     2          /* loss interval, cwnd change */
+#define RNN_Q      12
+#define RNN_ONE    (1 << RNN_Q)
+#define RNN_X_MAX  (2 * RNN_ONE)
+#define RNN_W_MAX  (4 * RNN_ONE)
+
+struct rnn_weights {
+    s32 wh[RNN_HIDDEN][RNN_HIDDEN];
+    s32 wx[RNN_HIDDEN][RNN_IN + 1]; /* the last column is for the label */
+    s32 bh[RNN_HIDDEN];
+    s32 wo[RNN_HIDDEN];
+    s32 wxo[RNN_IN];
+    s32 bo;
+};
+
+struct rnn_flow {
+    s16 h[RNN_HIDDEN];
+    u16 cwnd;   /* fixp_u16f code of the previous loss's cwnd, 0 before one */
+};
+
+static inline s32 rnn_clamp_x(s32 v)
+{
+    return v > RNN_X_MAX ? RNN_X_MAX : v < -RNN_X_MAX ? -RNN_X_MAX : v;
+}
+
+/* a code difference is log2 in 1/2^FIXP_U16F_MANT, log2 / 4 in Q12 is half of it */
+static inline void rnn_inputs(const struct rnn_flow *f, s32 *x,
+                              u32 elapsed, u32 srtt, u32 cwnd)
+{
+    if (elapsed > 0x1fffffff)
+        elapsed = 0x1fffffff;
+    x[0] = rnn_clamp_x(((s32)fixp_u16f_encode(elapsed << 3)
+                        - (s32)fixp_u16f_encode(srtt)) >> 1);
+    x[1] = f->cwnd ? rnn_clamp_x(((s32)fixp_u16f_encode(cwnd) - (s32)f->cwnd) >> 1) : 0;
+}
+
+/* z in Q24 (weight times input) */
+static inline s32 rnn_sigmoid(s32 z)
+{
+    return sigmoid_lookup(FIXP_HALF(ALPHA) + (z >> RNN_Q));
+}
+
+static inline s32 rnn_tanh(s32 z)
+{
+    return (2 * rnn_sigmoid(2 * z) - (1 << GAMMA)) >> (GAMMA - RNN_Q);
+}
+
+static inline s64 rnn_predict(const struct rnn_weights *w, const struct rnn_flow *f,
+                              u32 elapsed, u32 srtt, u32 cwnd)
+{
+    s32 x[RNN_IN], z = w->bo * RNN_ONE;
+    int i;
+
+    rnn_inputs(f, x, elapsed, srtt, cwnd);
+    for (i = 0; i < RNN_HIDDEN; i++)
+        z += w->wo[i] * f->h[i];
+    for (i = 0; i < RNN_IN; i++)
+        z += w->wxo[i] * x[i];
+    return rnn_sigmoid(z);
+}
+
+static inline void rnn_update(const struct rnn_weights *w, struct rnn_flow *f,
+                              u32 elapsed, u32 srtt, u32 cwnd, u32 label)
+{
+    s32 x[RNN_IN + 1], z;
+    s16 h[RNN_HIDDEN];
+    int i, j;
+
+    rnn_inputs(f, x, elapsed, srtt, cwnd);
+    x[RNN_IN] = label ? RNN_ONE : -RNN_ONE;
+    for (i = 0; i < RNN_HIDDEN; i++) {
+        z = w->bh[i] * RNN_ONE;
+        for (j = 0; j < RNN_HIDDEN; j++)
+            z += w->wh[i][j] * f->h[j];
+        for (j = 0; j <= RNN_IN; j++)
+            z += w->wx[i][j] * x[j];
+        h[i] = rnn_tanh(z);
+    }
+    for (i = 0; i < RNN_HIDDEN; i++)
+        f->h[i] = h[i];
+    f->cwnd = fixp_u16f_encode(cwnd);
+    if (!f->cwnd)
+        f->cwnd = 1;
+}
+
+#endif /* _RNN_H */
@@ -0,0 +1,34 @@
+/*
+ * generated by tools/tcp_pred_rnn, do not edit
+ *
+ *   tcp_pred_rnn -e 30 -r 0.001 -s 1 synth.trace synth_burst.trace
+ *
+ * 81792 losses in 128 flows, training accuracy 91.83%
+ */
+#ifndef _RNN_GEN_H
+#define _RNN_GEN_H
+
+#if RNN_HIDDEN != 4 || RNN_IN != 2 || RNN_Q != 12
+#error "rnn_gen.h is for another shape of the cell, regenerate it"
+#endif
+
+static const struct rnn_weights rnn_weights = {
+    .wh  = {
+        { -6359, -2534, 1550, -4255 },
+        { -7706, -8494, -3480, 3146 },
+        { -2394, -2588, 3988, 11312 },
+        { 930, -3931, -3910, 777 },
+    },
+    .wx  = {
+        { -411, 9141, -973 },
+        { -255, 16382, 855 },
+        { -1331, -13432, 5340 },
+        { -1258, -16383, -5269 },
+    },
+    .bh  = { -6783, 3673, -2988, 1243 },
+    .wo  = { -7954, -13927, 6045, 8151 },
+    .wxo = { 16384, 16384 },
+    .bo  = -2380,
+};
+
+#endif /* _RNN_GEN_H */
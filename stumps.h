@@ -0,0 +1,40 @@
+/*
+ * boosted decision stumps trained offline
+ *
+ * stumps_gen.h is written by tools/tcp_pred_stumps from loss traces
+ * (make -C tools stumps) and holds a chain of comparisons on the time
+ * since the previous loss in RTTs and on cwnd, adding up the log-odds
+ * of label 1. Evaluating it is a divide, compares and adds, nothing is
+ * learned at run time.
+ *
+ * The time is taken in RTTs, as in rnn.h, for the thresholds to hold
+ * on a kernel of another HZ than the traces': elapsed and srtt are
+ * both in jiffies, their ratio is not.
+ */
+#ifndef _STUMPS_H
+#define _STUMPS_H
+
+#include "perceptron.h"
+
+#define STUMPS_RTT_FRAC 3 /* the time since the last loss in 1/8 RTT */
+
+static inline u32 stumps_rtts(u32 elapsed, u32 srtt)
+{
+    if (elapsed > 0x1fffffff >> STUMPS_RTT_FRAC)
+        elapsed = 0x1fffffff >> STUMPS_RTT_FRAC;
+    return srtt ? (elapsed << (3 + STUMPS_RTT_FRAC)) / srtt : 0;
+}
+
+#include "stumps_gen.h"
+
+/* sigmoid[] is 1/4096 of log-odds per step */
+#if STUMPS_SCORE_ONE != 4096
+#error "stumps_gen.h is for another sigmoid[] scale, regenerate it"
+#endif
+
+static inline s64 stumps_predict(u32 elapsed, u32 srtt, u32 cwnd)
+{
+    return sigmoid_lookup(FIXP_HALF(ALPHA) + stumps_score(stumps_rtts(elapsed, srtt), cwnd));
+}
+
+#endif /* _STUMPS_H */
@@ -0,0 +1,53 @@
+/*
+ * generated by tools/tcp_pred_stumps, do not edit
+ *
+ *   tcp_pred_stumps -n 32 -r 0.3 synth.trace synth_burst.trace
+ *
+ * 81792 losses, training accuracy 86.35%
+ */
+#ifndef _STUMPS_GEN_H
+#define _STUMPS_GEN_H
+
+#define STUMPS_SCORE_ONE 4096
+
+/* log-odds of label 1 in 1/STUMPS_SCORE_ONE */
+static inline s32 stumps_score(u32 rtts, u32 cwnd)
+{
+    s32 s = -101;
+
+    s += rtts < 8U ? -2409 : 1430;
+    s += rtts < 8U ? -1874 : 1031;
+    s += rtts < 8U ? -1626 : 771;
+    s += rtts < 8U ? -1482 : 580;
+    s += rtts < 12U ? -1335 : 460;
+    s += rtts < 8U ? -1321 : 328;
+    s += rtts < 8U ? -1267 : 241;
+    s += rtts < 8U ? -1220 : 175;
+    s += cwnd < 343U ? -209 : 1149;
+    s += rtts < 8U ? -1167 : 133;
+    s += cwnd < 354U ? -134 : 1076;
+    s += rtts < 8U ? -1113 : 101;
+    s += rtts < 7U ? -1150 : 68;
+    s += cwnd < 367U ? -85 : 1044;
+    s += rtts < 6U ? -1217 : 48;
+    s += cwnd < 333U ? -87 : 624;
+    s += rtts < 6U ? -1199 : 36;
+    s += rtts < 12U ? -695 : 49;
+    s += cwnd < 367U ? -46 : 821;
+    s += rtts < 6U ? -1165 : 23;
+    s += cwnd < 383U ? -29 : 820;
+    s += rtts < 6U ? -1138 : 17;
+    s += cwnd < 145U ? -187 : 102;
+    s += rtts < 5U ? -1235 : 12;
+    s += cwnd < 60U ? -453 : 32;
+    s += cwnd < 383U ? -19 : 678;
+    s += rtts < 5U ? -1233 : 9;
+    s += rtts < 5U ? -1232 : 6;
+    s += cwnd < 343U ? -24 : 333;
+    s += cwnd < 56U ? -328 : 21;
+    s += cwnd < 401U ? -10 : 655;
+    s += rtts < 5U ? -1231 : 5;
+    return s;
+}
+
+#endif /* _STUMPS_GEN_H */
@@ -17,30 +17,56 @@
 #include <linux/module.h>
 #include <linux/kernel.h>
 #include <linux/random.h>
+#include <linux/percpu.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+#include <linux/timex.h>
+#include <linux/kfifo.h>
+#include <linux/hash.h>
+#include <linux/wait.h>
+#include <linux/slab.h>
+#include <linux/sysctl.h>
+#include <linux/pkt_sched.h>
 #include <net/tcp.h>
-#include "pow2.h"
-#include "sigmoid.h"
+#include <net/net_namespace.h>
+#include <net/netns/generic.h>
+#include "tcp_pred.h"
+#include "tcp_pred_model.h"
+#include "perceptron.h"
+#include "markov.h"
+#include "kalman.h"
+#include "holt.h"
+#include "bandit.h"
+#include "knn.h"
+#include "logistic.h"
+#include "stumps.h"
+#include "rnn.h"
+#include "rnn_gen.h"
+#include "ensemble.h"
 
 
 #define BICTCP_BETA_SCALE    1024	/* Scale factor beta calculation
                                      * max_cwnd = snd_cwnd * beta
                                      */
+/* what the output node of the perceptron is trained to predict */
+enum {
+    PRED_LABEL, /* next loss below/above last_max_cwnd */
+    PRED_WMAX,  /* next saturation cwnd, see wmax_target() */
+    PRED_KALMAN, /* Wmax from the per-flow filter in kalman.h, no model */
+    PRED_HOLT,   /* Wmax and time to the loss from holt.h, no model */
+};
+
+#define TCP_PRED_HOLT_SLOW_SHIFT 3 /* PRED_HOLT: the last 1/8 of the time to the loss */
+
 #define BICTCP_B		4	 /*
                               * In binary search,
                               * go to point (max+min)/N
                               */
 
-#define L 3
-#define M 4
-#define N 1
-#define ETA 3
-#define ALPHA 16
-#define BETA 16
-#define GAMMA 16
-#define DELTA 16
-#define LOOP_MAX 100
-#define HIS_LEN 6 //number of teacher data
-
+/*
+ * the tunables below are the defaults of a new network namespace,
+ * each namespace has its own copy under net.tcp_pred (sysctl)
+ */
 static int fast_convergence = 1;
 static int max_increment = 16;
 static int low_window = 14;
@@ -48,35 +74,175 @@ static int beta = 819;		/* = 819/1024 (BICTCP_BETA_SCALE) */
 static int gamma = 1100;
 static int initial_ssthresh;
 static int smooth_part = 20;
+static int trace;
+static int pred_mode = PRED_LABEL;
+static int min_confidence = CONF_INIT;
+static int adaptive_train = 1;
+static int seed;
+static int beta_bandit;
+static char model[TCP_PRED_MODEL_NAME_MAX] = "perceptron";
 
-module_param(fast_convergence, int, 0644);
+module_param(fast_convergence, int, 0444);
 MODULE_PARM_DESC(fast_convergence, "turn on/off fast convergence");
-module_param(max_increment, int, 0644);
+module_param(max_increment, int, 0444);
 MODULE_PARM_DESC(max_increment, "Limit on increment allowed during binary search");
-module_param(low_window, int, 0644);
+module_param(low_window, int, 0444);
 MODULE_PARM_DESC(low_window, "lower bound on congestion window (for TCP friendliness)");
-module_param(beta, int, 0644);
+module_param(beta, int, 0444);
 MODULE_PARM_DESC(beta, "beta for multiplicative increase");
 module_param(gamma, int, 0644);
 MODULE_PARM_DESC(beta, "gamma for multiplicative increase");
-module_param(initial_ssthresh, int, 0644);
+module_param(initial_ssthresh, int, 0444);
 MODULE_PARM_DESC(initial_ssthresh, "initial value of slow start threshold");
-module_param(smooth_part, int, 0644);
+module_param(smooth_part, int, 0444);
 MODULE_PARM_DESC(smooth_part, "log(B/(B*Smin))/log(B/(B-1))+B, # of RTT from Wmax-B to Wmax");
+module_param(trace, int, 0644);
+MODULE_PARM_DESC(trace, "write binary loss records to /proc/net/tcp_pred_trace");
+module_param(pred_mode, int, 0444);
+MODULE_PARM_DESC(pred_mode, "0: predict the loss label, 1: predict the next Wmax (a label with a label-only model), 2: Kalman-filtered Wmax, 3: Holt forecast of Wmax and time to loss");
+module_param(min_confidence, int, 0444);
+MODULE_PARM_DESC(min_confidence, "per-flow accuracy (0-255) below which predictions are skipped, 0 = never");
+module_param(adaptive_train, int, 0444);
+MODULE_PARM_DESC(adaptive_train, "retrain only after a miss or a srtt/cwnd drift");
+module_param(seed, int, 0444);
+MODULE_PARM_DESC(seed, "seed of the initial weights, 0 = random");
+module_param(beta_bandit, int, 0444);
+MODULE_PARM_DESC(beta_bandit, "learn beta per path from the goodput after each loss");
+module_param_string(model, model, sizeof(model), 0444);
+MODULE_PARM_DESC(model, "predictor model of a new namespace");
+
+/*
+ * per-cpu statistics
+ * hot path only bumps the local cpu's copy, the sum is taken
+ * when /proc/net/tcp_pred_stats is read. Each namespace has its own.
+ */
+enum {
+    TCP_PRED_STAT_LOSS,     /* bictcp_recalc_ssthresh() calls */
+    TCP_PRED_STAT_PREDICT,  /* get_prediction() on the loss path */
+    TCP_PRED_STAT_TRAIN,    /* train() runs */
+    TCP_PRED_STAT_TRAIN_SKIP, /* trainings saved by adaptive_train */
+    TCP_PRED_STAT_LABEL0,   /* loss below last_max_cwnd */
+    TCP_PRED_STAT_LABEL1,   /* loss at or above last_max_cwnd */
+    TCP_PRED_STAT_HIT,      /* prediction matched the label */
+    TCP_PRED_STAT_MISS,     /* prediction did not match the label */
+    TCP_PRED_STAT_TRACE_DROP, /* trace records lost, reader too slow */
+    TCP_PRED_STAT_GATED,    /* losses not predicted, confidence too low */
+    TCP_PRED_STAT_TRAIN_BATCHED, /* losses folded into a pending train() */
+    TCP_PRED_STAT_BANDIT_EXPLORE, /* beta_bandit arms played for a UCB bonus */
+    __TCP_PRED_STAT_MAX
+};
+
+static const char * const tcp_pred_stat_names[__TCP_PRED_STAT_MAX] = {
+    [TCP_PRED_STAT_LOSS]    = "loss",
+    [TCP_PRED_STAT_PREDICT] = "predict",
+    [TCP_PRED_STAT_TRAIN]   = "train",
+    [TCP_PRED_STAT_TRAIN_SKIP] = "train_skip",
+    [TCP_PRED_STAT_LABEL0]  = "label0",
+    [TCP_PRED_STAT_LABEL1]  = "label1",
+    [TCP_PRED_STAT_HIT]     = "hit",
+    [TCP_PRED_STAT_MISS]    = "miss",
+    [TCP_PRED_STAT_TRACE_DROP] = "trace_drop",
+    [TCP_PRED_STAT_GATED]   = "gated",
+    [TCP_PRED_STAT_TRAIN_BATCHED] = "train_batched",
+    [TCP_PRED_STAT_BANDIT_EXPLORE] = "bandit_explore",
+};
 
-/*parceptron parameters*/
-struct perceptron_param{
-    s64 wlm[L+1][M];
-    s64 wmn[M+1][N];
-    s64 dlm[L+1][M];
-    s64 dmn[M+1][N];
-    s64 Lout[L];
-    s64 Min[M];
-    s64 Mout[M];
-    s64 Nin[N];
-}p_param;
-
-/* BIC TCP Parameters */
+/* log2 histograms of cycles spent in each function */
+enum {
+    TCP_PRED_HIST_TRAIN,
+    TCP_PRED_HIST_PREDICT,
+    TCP_PRED_HIST_UPDATE,
+    __TCP_PRED_HIST_MAX
+};
+#define TCP_PRED_HIST_BUCKETS 32 /* bucket b counts [2^(b-1), 2^b) cycles */
+
+static const char * const tcp_pred_hist_names[__TCP_PRED_HIST_MAX] = {
+    [TCP_PRED_HIST_TRAIN]   = "train",
+    [TCP_PRED_HIST_PREDICT] = "get_prediction",
+    [TCP_PRED_HIST_UPDATE]  = "bictcp_update",
+};
+
+struct tcp_pred_stats {
+    u64 cnt[__TCP_PRED_STAT_MAX];
+    u64 hist[__TCP_PRED_HIST_MAX][TCP_PRED_HIST_BUCKETS];
+};
+
+/*
+ * an instance of a model, see tcp_pred_model.h
+ * a namespace holds a reference for each slot (model, prio_model[])
+ * naming it and every flow one for its lifetime, so flows keep their
+ * instance when the sysctl moves on. lock serializes the hooks.
+ */
+struct tcp_pred_model {
+    const struct tcp_pred_model_ops *ops;
+    atomic_t refcnt;
+    struct rcu_head rcu;
+    spinlock_t lock ____cacheline_aligned_in_smp;
+    bool trained;
+    u64 priv[0];
+};
+
+/*
+ * per network namespace state
+ * tenants in different namespaces see different paths, so each one
+ * gets its own tunables, statistics and models.
+ */
+struct tcp_pred_net {
+    int fast_convergence;
+    int max_increment;
+    int low_window;
+    int beta;
+    int initial_ssthresh;
+    int smooth_part;
+    int pred_mode;
+    int min_confidence;
+    int adaptive_train;
+    int beta_bandit;
+    /* per-socket overrides by sk_priority, 0 keeps the value above */
+    int prio_beta[TC_PRIO_MAX + 1];
+    int prio_max_increment[TC_PRIO_MAX + 1];
+    int prio_low_window[TC_PRIO_MAX + 1];
+    int prio_smooth_part[TC_PRIO_MAX + 1];
+    struct tcp_pred_stats __percpu *stats;
+    struct ctl_table_header *sysctl;
+    /* updated under tcp_pred_model_mutex, read under RCU */
+    struct tcp_pred_model __rcu *model;
+    struct tcp_pred_model __rcu *prio_model[TC_PRIO_MAX + 1]; /* NULL: model */
+    /* shared by the flows, the context tells their paths apart */
+    spinlock_t bandit_lock ____cacheline_aligned_in_smp;
+    struct beta_bandit bandit;
+} ____cacheline_aligned_in_smp;
+
+static int tcp_pred_net_id __read_mostly;
+static struct kmem_cache *tcp_pred_net_cachep __read_mostly;
+
+/* net_generic() only holds a pointer, the state is from tcp_pred_net_cachep */
+static inline struct tcp_pred_net *tcp_pred_pernet(const struct net *net)
+{
+    return *(struct tcp_pred_net **)net_generic(net, tcp_pred_net_id);
+}
+
+static inline struct tcp_pred_net *tcp_pred_net(const struct sock *sk)
+{
+    return tcp_pred_pernet(sock_net(sk));
+}
+
+#define TCP_PRED_INC_STATS(tn, field) this_cpu_inc((tn)->stats->cnt[field])
+
+static inline void tcp_pred_hist_add(struct tcp_pred_net *tn, int hist, cycles_t start)
+{
+    int b = fls64((u64)(get_cycles() - start));
+
+    if (b >= TCP_PRED_HIST_BUCKETS)
+        b = TCP_PRED_HIST_BUCKETS - 1;
+    this_cpu_inc(tn->stats->hist[hist][b]);
+}
+
+/*
+ * BIC TCP Parameters
+ * everything bictcp_update() and bictcp_acked() touch comes first and
+ * stays within one cacheline, the loss-path state and history follow.
+ */
 struct bictcp {
     u32	cnt;		/* increase cwnd by 1 after ACKs */
     u32 	last_max_cwnd;	/* last maximum snd_cwnd */
@@ -86,167 +252,92 @@ struct bictcp {
     u32	epoch_start;	/* beginning of an epoch */
 #define ACK_RATIO_SHIFT	4
     u32	delayed_ack;	/* estimate the ratio of Packets/ACKs << 4 */
+    /* tunables of this flow, from its namespace at bictcp_init() */
+    u16   max_increment;
+    u16   low_window;
+    u16   smooth_part;
+    u16   beta;
+    u16   wmax_sd;        /* how far off last_max_cwnd may be, PRED_KALMAN */
+
+    /* loss path */
+    u16   bandit_held;    /* the arm's reward held by ssthresh until the state change */
+#define TCP_PRED_HELD_REWARD    0xfff  /* BANDIT_REWARD_MAX fits */
+#define TCP_PRED_HELD_ARM_SHIFT 12     /* arm + 1, 0 if nothing is held */
+    u32   last_loss_time; /* time when previous packet loss */
+    u16   train_srtt;     /* srtt and cwnd at the last train(), fixp_u16f */
+    u16   train_cwnd;
+    struct tcp_pred_model *model;
+    union {                   /* TCP_PRED_F_HOLT tells which */
+        struct wmax_kalman kalman;
+        struct holt holt;
+    };
+    u8    index;
+    u8    confidence;     /* see CONF_INIT */
+#define TCP_PRED_F_WMAX    0x1 /* last_max_cwnd is a PRED_WMAX prediction */
+#define TCP_PRED_F_MISS    0x2 /* the last scored prediction was wrong */
+#define TCP_PRED_F_TRAINED 0x4 /* train_srtt/train_cwnd are valid */
+#define TCP_PRED_F_READY   0x8 /* the history ring is full */
+#define TCP_PRED_F_TRAIN_PENDING 0x10 /* train() at the end of the recovery episode */
+#define TCP_PRED_F_ARM_SHIFT 5         /* beta_bandit arm + 1 played at the last loss */
+#define TCP_PRED_F_ARM     (3 << TCP_PRED_F_ARM_SHIFT)
+#define TCP_PRED_F_HOLT    0x80 /* the union holds holt, pred_mode was PRED_HOLT */
+    u8    flags;
+    u8    answers;        /* bit i is the label of history entry i */
+    u32   bandit_una;     /* snd_una at the last loss, for the arm's reward */
 #define NUMBER_OF_HISTORY 2 /* no meaning for default*/
+    /* fixp_u16f codes, a plain u16 wraps on long idle periods and long paths */
     u16   elapsed[HIS_LEN];
     u16   rtt[HIS_LEN];
     u16   cwnd[HIS_LEN];
-    u8    answer[HIS_LEN];
-    u8    index;
-    u8    ready;
-    u32   last_loss_time; /* time when previous packet loss */
+    u32   model_tag;      /* tcp_pred_model_tag() of the socket that holds model */
+    u64   model_flow[TCP_PRED_MODEL_FLOW_SIZE / sizeof(u64)]; /* the model's */
 };
 
-static void initialize_perceptron(void){
-    int i,j;
-    for(i=0;i<L+1;i++){
-        for(j=0;j<M;j++){
-            p_param.wlm[i][j] = random32() % (pow2[DELTA+1]+1) - pow2[DELTA];
-        }
-    }
-    for(i=0;i<M+1;i++){
-        for(j=0;j<N;j++){
-            p_param.wmn[i][j] = random32() % (pow2[DELTA+1]+1) - pow2[DELTA];
-        }
-    }
-}
-
-static void initialize_edge_delta(void){
-    int i,j;
-    for(i=0;i<L+1;i++){
-        for(j=0;j<M;j++){
-            p_param.dlm[i][j] = 0;
-        }
-    }
-    for(i=0;i<M+1;i++){
-        for(j=0;j<N;j++){
-            p_param.dmn[i][j] = 0;
-        }
-    }
-}
-
-static s64 get_prediction(u16 elapsed, u16 srtt, u16 cwnd){
-    s64 modin;
-    int i,j;
-    //L層の出力としてcaからデータを取る
-    p_param.Lout[0] = elapsed;
-    p_param.Lout[1] = srtt;
-    p_param.Lout[2] = cwnd;
-
-    //M層のi-thノードに対する入力値を計算する
-    for(i=0;i<M;i++){
-        p_param.Min[i] = 0;
-        //Lout * weightの和を計算
-        for(j=0;j<L;j++){
-            p_param.Min[i] += p_param.wlm[j][i] * p_param.Lout[j];
-        }
-        //M層のi番目ノードの閾値分を入力から減算
-        p_param.Min[i] += p_param.wlm[L][i] * -1;
-    }
+/* icsk_ca_priv kept free for later per-flow state, none is left */
+#define TCP_PRED_CA_HEADROOM 0
 
-    //M層i-thノードのoutputを計算する    
-    for(i=0;i<M;i++){
-        modin = (p_param.Min[i] >> (1 + DELTA - ALPHA)) / BETA + pow2[ALPHA-1];
-        if(0 <= modin && modin < (1 << ALPHA)){
-            p_param.Mout[i] = sigmoid[modin];
-        }else if(modin < 0){
-            p_param.Mout[i] = 0;
-        }else{
-            p_param.Mout[i] = 1 << GAMMA;
-        }
-    }
-
-    //N層i-thノードへの入力値を計算する
-    for(i=0;i<N;i++){
-        p_param.Nin[i] = 0;
-        for(j=0;j<M;j++){
-            //M層output * weightの和を計算
-            p_param.Nin[i] += p_param.wmn[j][i] * p_param.Mout[j];
-        }
-        p_param.Nin[i] += p_param.wmn[M][i] * -1;
-    }
+/*
+ * loss trace
+ * many writers (one per loss) go through tcp_pred_trace_lock,
+ * the single reader is serialized by tcp_pred_trace_mutex.
+ * There is one trace for the host, read from init_net's /proc/net.
+ */
+#define TCP_PRED_TRACE_LEN 4096 /* records, must be a power of 2 */
+static DEFINE_KFIFO(tcp_pred_trace_fifo, struct tcp_pred_trace_rec, TCP_PRED_TRACE_LEN);
+static DEFINE_SPINLOCK(tcp_pred_trace_lock);
+static DEFINE_MUTEX(tcp_pred_trace_mutex);
+static DECLARE_WAIT_QUEUE_HEAD(tcp_pred_trace_wait);
 
-    modin = (p_param.Nin[0] >> (1+GAMMA+DELTA-ALPHA)) / BETA + pow2[ALPHA-1];
-    if(0 <= modin && modin < (1 << ALPHA)){
-        return sigmoid[modin];
-    }else if(modin < 0){
-        return 0;
-    }else{
-        return 1 << GAMMA;
-    }
-}
-
-static void train(struct bictcp *ca){
-    s64 result, delta_k, delta_j;
-    int x,i,j,k;
-    int ans;
-
-    initialize_perceptron();
-
-    for(x=0;x<LOOP_MAX;x++){
-        //差分変数の初期化
-        initialize_edge_delta();
-
-        //全ての教師データに対して
-        for(i=0;i<HIS_LEN;i++){
-            //教師データを取得する必要がある
-            ans = ca->answer[i];
-
-            //予測を出す
-            result = get_prediction(ca->elapsed[i],
-                                    ca->rtt[i],
-                                    ca->cwnd[i]);
-
-            delta_k = (ans << GAMMA) - result;
-            delta_k *= (1 << GAMMA) - result;
-            delta_k >>= GAMMA;
-            delta_k *= result;
-            delta_k >>= GAMMA;
-
-            //M->Nの偏微分値
-            for(j=0;j<M+1;j++){
-                for(k=0;k<N;k++){
-                    if(j != M){
-                        p_param.dmn[j][k] += (((delta_k * p_param.Mout[j]) >> GAMMA) << DELTA) >> GAMMA;
-                    }else{
-                        p_param.dmn[j][k] += ((delta_k * -1) << DELTA) >> GAMMA;
-                    }
-                }
-            }
+static void tcp_pred_trace_loss(struct tcp_pred_net *tn, const struct sock *sk,
+                                u32 elapsed, u8 label)
+{
+    const struct tcp_sock *tp = tcp_sk(sk);
+    const struct inet_sock *inet = inet_sk(sk);
+    const struct bictcp *ca = inet_csk_ca(sk);
+    struct tcp_pred_trace_rec rec = {
+        .flow      = (u32)ntohs(inet->inet_sport) << 16 | ntohs(inet->inet_dport),
+        .time      = tcp_time_stamp,
+        .elapsed   = elapsed,
+        .srtt      = tp->srtt,
+        .cwnd      = tp->snd_cwnd,
+        .ssthresh  = tp->snd_ssthresh,
+        .loss_cwnd = ca->loss_cwnd,
+        .label     = label,
+    };
 
-            //L->Mの偏微分値
-            for(j=0;j<M;j++){
-                delta_j = (delta_k * p_param.wmn[j][0]) >> DELTA;
-                delta_j *= p_param.Mout[j];
-                delta_j >>= GAMMA;
-                delta_j *= (1<<GAMMA) - p_param.Mout[j];
-                delta_j >>= GAMMA;
-                for(k=0;k<L+1;k++){
-                    if(k != L){
-                        p_param.dlm[k][j] += (((delta_j * p_param.Lout[k]) >> GAMMA) << DELTA) >> GAMMA;
-                    }else{
-                        p_param.dlm[k][j] += ((delta_j * -1) << DELTA) >> GAMMA;
-                    }
-                }
-            }
-        }
-        for(i=0;i<L+1;i++){
-            for(j=0;j<M;j++){
-                p_param.wlm[i][j] += p_param.dlm[i][j] >> ETA;
-            }
-        }
-        for(i=0;i<M+1;i++){
-            for(j=0;j<N;j++){
-                p_param.wmn[i][j] += p_param.dmn[i][j] >> ETA;
-            }
-        }
-    }
+    if (!kfifo_in_spinlocked(&tcp_pred_trace_fifo, &rec, 1, &tcp_pred_trace_lock))
+        TCP_PRED_INC_STATS(tn, TCP_PRED_STAT_TRACE_DROP);
+    else
+        wake_up_interruptible(&tcp_pred_trace_wait);
 }
 
+
 static inline void bictcp_reset(struct bictcp *ca)
 {
     int i;
     ca->cnt = 0;
     ca->last_max_cwnd = 0;
+    ca->wmax_sd = 0;
     ca->loss_cwnd = 0;
     ca->last_cwnd = 0;
     ca->last_time = 0;
@@ -254,20 +345,389 @@ static inline void bictcp_reset(struct bictcp *ca)
     ca->delayed_ack = 2 << ACK_RATIO_SHIFT;
     ca->last_loss_time = 0;
     ca->index = 0;
-    ca->ready = 0;
+    ca->answers = 0;
+    ca->confidence = CONF_INIT;
+    ca->flags = 0;
+    ca->train_srtt = 0;
+    ca->train_cwnd = 0;
+    ca->bandit_una = 0;
+    ca->bandit_held = 0;
     for(i=0;i<HIS_LEN;i++){
         ca->elapsed[i] = 0;
         ca->rtt[i] = 0;
         ca->cwnd[i] = 0;
-        ca->answer[i] = 0;
     }
+    memset(&ca->kalman, 0, sizeof(ca->kalman));
+    memset(ca->model_flow, 0, sizeof(ca->model_flow));
+}
+
+/*
+ * model registry, like tcp_register_congestion_control()
+ * the list is changed under tcp_pred_model_list_lock and read under
+ * RCU, namespace slots are changed under tcp_pred_model_mutex
+ */
+static DEFINE_SPINLOCK(tcp_pred_model_list_lock);
+static LIST_HEAD(tcp_pred_model_list);
+static DEFINE_MUTEX(tcp_pred_model_mutex);
+
+static struct tcp_pred_model_ops *tcp_pred_model_find(const char *name)
+{
+    struct tcp_pred_model_ops *ops;
+
+    list_for_each_entry_rcu(ops, &tcp_pred_model_list, list) {
+        if (strcmp(ops->name, name) == 0)
+            return ops;
+    }
+    return NULL;
+}
+
+int tcp_pred_register_model(struct tcp_pred_model_ops *ops)
+{
+    int ret = 0;
+
+    if (!ops->predict || ops->flow_size > TCP_PRED_MODEL_FLOW_SIZE) {
+        printk(KERN_ERR "tcp_pred: model %s is not usable\n", ops->name);
+        return -EINVAL;
+    }
+
+    spin_lock(&tcp_pred_model_list_lock);
+    if (tcp_pred_model_find(ops->name)) {
+        printk(KERN_NOTICE "tcp_pred: model %s already registered\n", ops->name);
+        ret = -EEXIST;
+    } else {
+        list_add_tail_rcu(&ops->list, &tcp_pred_model_list);
+        printk(KERN_INFO "tcp_pred: model %s registered\n", ops->name);
+    }
+    spin_unlock(&tcp_pred_model_list_lock);
+    return ret;
+}
+EXPORT_SYMBOL_GPL(tcp_pred_register_model);
+
+/* instances hold a reference on ops->owner, so none are left here */
+void tcp_pred_unregister_model(struct tcp_pred_model_ops *ops)
+{
+    spin_lock(&tcp_pred_model_list_lock);
+    list_del_rcu(&ops->list);
+    spin_unlock(&tcp_pred_model_list_lock);
+    synchronize_rcu();
+}
+EXPORT_SYMBOL_GPL(tcp_pred_unregister_model);
+
+static struct tcp_pred_model *tcp_pred_model_create(const char *name)
+{
+    struct tcp_pred_model_ops *ops;
+    struct tcp_pred_model *m;
+    int ret;
+
+    rcu_read_lock();
+    ops = tcp_pred_model_find(name);
+    if (ops && !try_module_get(ops->owner))
+        ops = NULL;
+    rcu_read_unlock();
+    if (!ops)
+        return ERR_PTR(-ENOENT);
+
+    /* power of 2 sized kmalloc()s are naturally aligned, so lock gets its cacheline */
+    m = kzalloc(roundup_pow_of_two(sizeof(*m) + ops->priv_size), GFP_KERNEL);
+    if (!m) {
+        ret = -ENOMEM;
+        goto out;
+    }
+    m->ops = ops;
+    atomic_set(&m->refcnt, 1);
+    spin_lock_init(&m->lock);
+    if (ops->init) {
+        ret = ops->init(m->priv, seed ? seed : get_random_int());
+        if (ret)
+            goto out_free;
+    }
+    return m;
+
+out_free:
+    kfree(m);
+out:
+    module_put(ops->owner);
+    return ERR_PTR(ret);
+}
+
+static void tcp_pred_model_free(struct rcu_head *head)
+{
+    struct tcp_pred_model *m = container_of(head, struct tcp_pred_model, rcu);
+
+    if (m->ops->release)
+        m->ops->release(m->priv);
+    module_put(m->ops->owner);
+    kfree(m);
+}
+
+/* a model with no shared state has nothing to serialize across flows */
+static inline void tcp_pred_model_lock(struct tcp_pred_model *m)
+{
+    if (m->ops->priv_size)
+        spin_lock_bh(&m->lock);
+}
+
+static inline void tcp_pred_model_unlock(struct tcp_pred_model *m)
+{
+    if (m->ops->priv_size)
+        spin_unlock_bh(&m->lock);
+}
+
+static void tcp_pred_model_put(struct tcp_pred_model *m)
+{
+    if (atomic_dec_and_test(&m->refcnt))
+        call_rcu(&m->rcu, tcp_pred_model_free);
+}
+
+/*
+ * icsk_ca_priv is not cleared between sockets: a clone copies the
+ * listener's, tcp_disconnect() keeps it without ->release, and a socket
+ * switched to tcp_pred while closed has another module's data in it.
+ * ca->model_tag ties ca->model to the socket that took the reference,
+ * a pointer found with another socket's tag is not ours to put.
+ */
+static inline u32 tcp_pred_model_tag(const struct sock *sk, const struct tcp_pred_model *m)
+{
+    return hash_ptr((void *)((unsigned long)sk ^ (unsigned long)m), 32);
+}
+
+static inline bool tcp_pred_model_owned(const struct sock *sk, const struct bictcp *ca)
+{
+    return ca->model && ca->model_tag == tcp_pred_model_tag(sk, ca->model);
+}
+
+/* the instance for a new flow, pinned until bictcp_release() */
+static struct tcp_pred_model *tcp_pred_model_get(struct tcp_pred_net *tn, u32 priority)
+{
+    struct tcp_pred_model *m;
+
+    rcu_read_lock();
+    do {
+        m = NULL;
+        if (priority <= TC_PRIO_MAX)
+            m = rcu_dereference(tn->prio_model[priority]);
+        if (!m)
+            m = rcu_dereference(tn->model);
+    } while (!atomic_inc_not_zero(&m->refcnt)); /* lost a race with the sysctl */
+    rcu_read_unlock();
+    return m;
+}
+
+/*
+ * point a slot of the namespace at the model called name, sharing the
+ * instance with the other slots if one of them already uses it.
+ * "-" clears a prio_model[] slot.
+ */
+static int tcp_pred_model_set(struct tcp_pred_net *tn,
+                              struct tcp_pred_model __rcu **slot, const char *name)
+{
+    struct tcp_pred_model *m = NULL, *old;
+    int i;
+
+    if (strcmp(name, "-") == 0) {
+        if (slot == &tn->model)
+            return -EINVAL;
+        goto set;
+    }
+    for (i = -1; i <= TC_PRIO_MAX; i++) {
+        m = rcu_dereference_protected(i < 0 ? tn->model : tn->prio_model[i],
+                                      lockdep_is_held(&tcp_pred_model_mutex));
+        if (m && strcmp(m->ops->name, name) == 0) {
+            atomic_inc(&m->refcnt);
+            goto set;
+        }
+    }
+    m = tcp_pred_model_create(name);
+    if (IS_ERR(m))
+        return PTR_ERR(m);
+set:
+    old = rcu_dereference_protected(*slot, lockdep_is_held(&tcp_pred_model_mutex));
+    rcu_assign_pointer(*slot, m);
+    if (old)
+        tcp_pred_model_put(old);
+    return 0;
+}
+
+/* the built-in model, see perceptron.h */
+static int tcp_pred_perceptron_init(void *priv, u32 seed)
+{
+    initialize_perceptron(priv, seed);
+    return 0;
+}
+
+static u32 tcp_pred_perceptron_predict(void *priv, void *flow,
+                                       const struct tcp_pred_sample *s)
+{
+    return get_prediction(priv, s->elapsed, s->srtt, s->cwnd);
+}
+
+static void tcp_pred_perceptron_observe(void *priv, void *flow,
+                                        const struct tcp_pred_sample *s)
+{
+    struct perceptron_param *p = priv;
+
+    norm_update(&p->norm, s->elapsed, s->srtt, s->cwnd);
+}
+
+static void tcp_pred_perceptron_train(void *priv, void *flow,
+                                      const struct tcp_pred_hist *h)
+{
+    train(priv, h->elapsed, h->rtt, h->cwnd, h->target);
+}
+
+static struct tcp_pred_model_ops tcp_pred_perceptron = {
+    .priv_size = sizeof(struct perceptron_param),
+    .flags     = TCP_PRED_MODEL_WMAX,
+    .init      = tcp_pred_perceptron_init,
+    .predict   = tcp_pred_perceptron_predict,
+    .observe   = tcp_pred_perceptron_observe,
+    .train     = tcp_pred_perceptron_train,
+    .name      = "perceptron",
+    /* no owner, it lives as long as tcp_pred */
+};
+
+/* the label-sequence model, see markov.h */
+static u32 tcp_pred_markov_predict(void *priv, void *flow,
+                                   const struct tcp_pred_sample *s)
+{
+    return markov_predict(flow);
+}
+
+static void tcp_pred_markov_observe(void *priv, void *flow,
+                                    const struct tcp_pred_sample *s)
+{
+    markov_update(flow, s->label);
+}
+
+static struct tcp_pred_model_ops tcp_pred_markov = {
+    .flow_size = sizeof(struct markov_flow),
+    .predict   = tcp_pred_markov_predict,
+    .observe   = tcp_pred_markov_observe,
+    .name      = "markov",
+};
+
+/* nearest neighbours in the flow's own history, see knn.h */
+static u32 tcp_pred_knn_predict(void *priv, void *flow,
+                                const struct tcp_pred_sample *s)
+{
+    const struct tcp_pred_hist *h = s->hist;
+
+    return knn_predict(h->elapsed, h->rtt, h->cwnd, h->target, h->newest,
+                       s->elapsed, s->srtt, s->cwnd);
+}
+
+static struct tcp_pred_model_ops tcp_pred_knn = {
+    .flags     = TCP_PRED_MODEL_WMAX,
+    .predict   = tcp_pred_knn_predict,
+    .name      = "knn",
+};
+
+/* online logistic regression, see logistic.h */
+static u32 tcp_pred_logistic_predict(void *priv, void *flow,
+                                     const struct tcp_pred_sample *s)
+{
+    return logistic_predict(priv, s->elapsed, s->srtt, s->cwnd);
+}
+
+static void tcp_pred_logistic_observe(void *priv, void *flow,
+                                      const struct tcp_pred_sample *s)
+{
+    logistic_update(priv, s->elapsed, s->srtt, s->cwnd, s->label);
+}
+
+static struct tcp_pred_model_ops tcp_pred_logistic = {
+    .priv_size = sizeof(struct logistic_param),
+    .predict   = tcp_pred_logistic_predict,
+    .observe   = tcp_pred_logistic_observe,
+    .name      = "logistic",
+};
+
+/* trained offline by tools/tcp_pred_stumps, see stumps.h */
+static u32 tcp_pred_stumps_predict(void *priv, void *flow,
+                                   const struct tcp_pred_sample *s)
+{
+    return stumps_predict(s->elapsed, s->srtt, s->cwnd);
+}
+
+static struct tcp_pred_model_ops tcp_pred_stumps = {
+    .predict   = tcp_pred_stumps_predict,
+    .name      = "stumps",
+};
+
+/* recurrent cell with weights from tools/tcp_pred_rnn, see rnn.h */
+static u32 tcp_pred_rnn_predict(void *priv, void *flow,
+                                const struct tcp_pred_sample *s)
+{
+    return rnn_predict(&rnn_weights, flow, s->elapsed, s->srtt, s->cwnd);
+}
+
+static void tcp_pred_rnn_observe(void *priv, void *flow,
+                                 const struct tcp_pred_sample *s)
+{
+    rnn_update(&rnn_weights, flow, s->elapsed, s->srtt, s->cwnd, s->label);
+}
+
+static struct tcp_pred_model_ops tcp_pred_rnn = {
+    .flow_size = sizeof(struct rnn_flow),
+    .predict   = tcp_pred_rnn_predict,
+    .observe   = tcp_pred_rnn_observe,
+    .name      = "rnn",
+};
+
+/*
+ * perceptron, markov and label EWMA weighted per flow, see ensemble.h;
+ * the votes are labels, so its perceptron learns labels in any pred_mode
+ */
+static u32 tcp_pred_ensemble_predict(void *priv, void *flow,
+                                     const struct tcp_pred_sample *s)
+{
+    return ensemble_predict(flow, priv, s->elapsed, s->srtt, s->cwnd);
+}
+
+static void tcp_pred_ensemble_observe(void *priv, void *flow,
+                                      const struct tcp_pred_sample *s)
+{
+    tcp_pred_perceptron_observe(priv, flow, s);
+    ensemble_update(flow, s->label);
+}
+
+static struct tcp_pred_model_ops tcp_pred_ensemble = {
+    .priv_size = sizeof(struct perceptron_param),
+    .flow_size = sizeof(struct ensemble_flow),
+    .init      = tcp_pred_perceptron_init,
+    .predict   = tcp_pred_ensemble_predict,
+    .observe   = tcp_pred_ensemble_observe,
+    .train     = tcp_pred_perceptron_train,
+    .name      = "ensemble",
+};
+
+/* the namespace's value, or the override for the socket's priority */
+static u16 tcp_pred_tunable(int val, const int *prio, u32 priority)
+{
+    if (priority <= TC_PRIO_MAX && prio[priority])
+        return prio[priority];
+    return val;
 }
 
 static void bictcp_init(struct sock *sk)
 {
-    bictcp_reset(inet_csk_ca(sk));
-    if (initial_ssthresh)
-        tcp_sk(sk)->snd_ssthresh = initial_ssthresh;
+    struct tcp_pred_net *tn = tcp_pred_net(sk);
+    struct bictcp *ca = inet_csk_ca(sk);
+    u32 priority = sk->sk_priority;
+
+    /* still ours after tcp_disconnect(), see tcp_pred_model_tag() */
+    if (tcp_pred_model_owned(sk, ca))
+        tcp_pred_model_put(ca->model);
+    bictcp_reset(ca);
+    ca->model = tcp_pred_model_get(tn, priority);
+    ca->model_tag = tcp_pred_model_tag(sk, ca->model);
+    ca->beta = tcp_pred_tunable(tn->beta, tn->prio_beta, priority);
+    ca->max_increment = tcp_pred_tunable(tn->max_increment, tn->prio_max_increment,
+                                         priority);
+    ca->low_window = tcp_pred_tunable(tn->low_window, tn->prio_low_window, priority);
+    ca->smooth_part = tcp_pred_tunable(tn->smooth_part, tn->prio_smooth_part, priority);
+    if (tn->initial_ssthresh)
+        tcp_sk(sk)->snd_ssthresh = tn->initial_ssthresh;
 }
 
 /*
@@ -286,38 +746,57 @@ static inline void bictcp_update(struct bictcp *ca, u32 cwnd)
         ca->epoch_start = tcp_time_stamp;
 
     /* start off normal */
-    if (cwnd <= low_window) {
+    if (cwnd <= ca->low_window) {
         ca->cnt = cwnd;
         return;
     }
 
-    /* binary increase */
-    if (cwnd < ca->last_max_cwnd) {
-        __u32 	dist = (ca->last_max_cwnd - cwnd)
+    /*
+     * binary increase
+     * an uncertain Wmax (wmax_sd) widens the plateau around it: the
+     * search aims wmax_sd below last_max_cwnd, max probing starts
+     * wmax_sd above it
+     */
+    if (cwnd + ca->wmax_sd < ca->last_max_cwnd) {
+        __u32 	dist = (ca->last_max_cwnd - ca->wmax_sd - cwnd)
             / BICTCP_B;
 
-        if (dist > max_increment)
+        if (dist > ca->max_increment)
             /* linear increase */
-            ca->cnt = cwnd / max_increment;
+            ca->cnt = cwnd / ca->max_increment;
         else if (dist <= 1U){
             /* binary search increase */
-            ca->cnt = (cwnd * smooth_part) / BICTCP_B;
+            ca->cnt = (cwnd * ca->smooth_part) / BICTCP_B;
         }
         else
             /* binary search increase */
             ca->cnt = cwnd / dist;
     } else {
         /* slow start AMD linear increase */
-        if (cwnd < ca->last_max_cwnd + BICTCP_B)
+        if (cwnd < ca->last_max_cwnd + ca->wmax_sd + BICTCP_B)
             /* slow start */
-            ca->cnt = (cwnd * smooth_part) / BICTCP_B;
-        else if (cwnd < ca->last_max_cwnd + max_increment*(BICTCP_B-1))
+            ca->cnt = (cwnd * ca->smooth_part) / BICTCP_B;
+        else if (cwnd < ca->last_max_cwnd + ca->wmax_sd + ca->max_increment*(BICTCP_B-1))
             /* slow start */
             ca->cnt = (cwnd * (BICTCP_B-1))
-                / (cwnd - ca->last_max_cwnd);
+                / (cwnd - ca->last_max_cwnd - ca->wmax_sd);
         else
             /* linear increase */
-            ca->cnt = cwnd / max_increment;
+            ca->cnt = cwnd / ca->max_increment;
+    }
+
+    /*
+     * PRED_HOLT: close to the forecast loss grow as slowly as on the
+     * plateau, whatever the distance to last_max_cwnd; before that and
+     * once the loss is overdue, as above
+     */
+    if ((ca->flags & (TCP_PRED_F_HOLT | TCP_PRED_F_WMAX)) ==
+        (TCP_PRED_F_HOLT | TCP_PRED_F_WMAX)) {
+        u32 due = holt_interval(&ca->holt);
+        u32 since = tcp_time_stamp - ca->last_loss_time;
+
+        if (since <= due && since + (due >> TCP_PRED_HOLT_SLOW_SHIFT) >= due)
+            ca->cnt = max(ca->cnt, (cwnd * ca->smooth_part) / BICTCP_B);
     }
 
     /* if in slow start or link utilization is very low */
@@ -342,7 +821,9 @@ static void bictcp_cong_avoid(struct sock *sk, u32 ack, u32 in_flight)
     if (tp->snd_cwnd <= tp->snd_ssthresh)
         tcp_slow_start(tp);
     else {
+        cycles_t start = get_cycles();
         bictcp_update(ca, tp->snd_cwnd);
+        tcp_pred_hist_add(tcp_pred_net(sk), TCP_PRED_HIST_UPDATE, start);
         tcp_cong_avoid_ai(tp, ca->cnt);
     }
 
@@ -356,13 +837,226 @@ static void bictcp_cong_avoid(struct sock *sk, u32 ack, u32 in_flight)
  *      NOTE:this function is called when a packet was dropped.
  *      the reason is this code "ca->loss_cwnd = tp->snd_cwnd;"
  */
+static void tcp_pred_score(struct tcp_pred_net *tn, struct bictcp *ca, bool hit)
+{
+    TCP_PRED_INC_STATS(tn, hit ? TCP_PRED_STAT_HIT : TCP_PRED_STAT_MISS);
+    ca->confidence += ((hit ? 255 : 0) - ca->confidence) >> CONF_EWMA;
+    if (hit)
+        ca->flags &= ~TCP_PRED_F_MISS;
+    else
+        ca->flags |= TCP_PRED_F_MISS;
+}
+
+/* whether the shared weights are still good for this flow */
+static bool tcp_pred_need_train(const struct tcp_pred_net *tn, const struct bictcp *ca,
+                                u32 srtt, u32 cwnd)
+{
+    if (!tn->adaptive_train || !ca->model->trained)
+        return true;
+    if ((ca->flags & (TCP_PRED_F_MISS | TCP_PRED_F_TRAINED)) != TCP_PRED_F_TRAINED)
+        return true;
+    return pred_drifted(fixp_u16f_decode(ca->train_srtt), srtt) ||
+           pred_drifted(fixp_u16f_decode(ca->train_cwnd), cwnd);
+}
+
+/* whether the flow's predictions are good enough to be used */
+static bool tcp_pred_confident(struct tcp_pred_net *tn, struct bictcp *ca)
+{
+    if (ca->confidence >= tn->min_confidence)
+        return true;
+    ca->confidence = min(ca->confidence + CONF_PROBE, 255);
+    TCP_PRED_INC_STATS(tn, TCP_PRED_STAT_GATED);
+    return false;
+}
+
+/* PRED_WMAX with a model that predicts Wmax, see TCP_PRED_MODEL_WMAX */
+static inline bool tcp_pred_wmax_model(const struct tcp_pred_net *tn,
+                                       const struct tcp_pred_model *m)
+{
+    return tn->pred_mode == PRED_WMAX && (m->ops->flags & TCP_PRED_MODEL_WMAX);
+}
+
+/*
+ * teacher data for the history ring
+ * for PRED_WMAX the target of entry i is the cwnd of the loss after it,
+ * the newest entry has no next loss yet and is left out.
+ */
+static void tcp_pred_targets(const struct tcp_pred_net *tn, const struct bictcp *ca,
+                             s64 *target)
+{
+    int i, newest = (ca->index + HIS_LEN - 1) % HIS_LEN;
+
+    if (!tcp_pred_wmax_model(tn, ca->model)) {
+        label_targets(ca->answers, target);
+        return;
+    }
+    for (i = 0; i < HIS_LEN; i++)
+        target[i] = i == newest ? TCP_PRED_NO_TARGET
+            : wmax_target(fixp_u16f_decode(ca->cwnd[i]),
+                          fixp_u16f_decode(ca->cwnd[(i + 1) % HIS_LEN]));
+}
+
+/* the history ring as the models see it, target[] is filled in */
+static void tcp_pred_hist(const struct tcp_pred_net *tn, const struct bictcp *ca,
+                          struct tcp_pred_hist *h, s64 *target)
+{
+    h->elapsed = ca->elapsed;
+    h->rtt = ca->rtt;
+    h->cwnd = ca->cwnd;
+    h->target = target;
+    h->newest = (ca->index + HIS_LEN - 1) % HIS_LEN;
+    tcp_pred_targets(tn, ca, target);
+}
+
+/*
+ * the training put off by bictcp_recalc_ssthresh(), one per recovery
+ * episode however many losses it had
+ */
+static void tcp_pred_train(struct tcp_pred_net *tn, struct bictcp *ca)
+{
+    struct tcp_pred_model *m = ca->model;
+    int newest = (ca->index + HIS_LEN - 1) % HIS_LEN;
+    s64 target[HIS_LEN];
+    struct tcp_pred_hist h;
+    cycles_t start;
+
+    tcp_pred_hist(tn, ca, &h, target);
+    tcp_pred_model_lock(m);
+    start = get_cycles();
+    m->ops->train(m->priv, ca->model_flow, &h);
+    tcp_pred_hist_add(tn, TCP_PRED_HIST_TRAIN, start);
+    m->trained = true;
+    tcp_pred_model_unlock(m);
+    TCP_PRED_INC_STATS(tn, TCP_PRED_STAT_TRAIN);
+    ca->train_srtt = ca->rtt[newest];
+    ca->train_cwnd = ca->cwnd[newest];
+    ca->flags &= ~TCP_PRED_F_TRAIN_PENDING;
+    ca->flags |= TCP_PRED_F_TRAINED;
+}
+
+/*
+ * back off towards a predicted Wmax: at least Reno's cwnd/2, at most
+ * the fast convergence point cwnd*(1+beta)/2
+ */
+static u32 tcp_pred_wmax_ssthresh(const struct bictcp *ca, u32 cwnd, u32 md_beta)
+{
+    return clamp_t(u32, (ca->last_max_cwnd * md_beta) / BICTCP_BETA_SCALE,
+                   cwnd >> 1U,
+                   (cwnd * (BICTCP_BETA_SCALE + md_beta)) / (2 * BICTCP_BETA_SCALE));
+}
+
+static void tcp_pred_bandit_update(struct tcp_pred_net *tn, u32 ctx, u32 arm, u32 reward)
+{
+    spin_lock_bh(&tn->bandit_lock);
+    bandit_update(&tn->bandit, ctx, arm, reward);
+    spin_unlock_bh(&tn->bandit_lock);
+}
+
+/*
+ * the context of the loss an arm was played at, age 1 for the newest
+ * history entry: ssthresh adds an entry after it holds the arm's pay,
+ * so the held arm's loss is then age 2
+ */
+static u32 tcp_pred_bandit_context(const struct bictcp *ca, int age)
+{
+    int i = (ca->index + HIS_LEN - age) % HIS_LEN;
+
+    return bandit_context(fixp_u16f_decode(ca->elapsed[i]),
+                          fixp_u16f_decode(ca->rtt[i]),
+                          fixp_u16f_decode(ca->cwnd[i]));
+}
+
+/*
+ * the pay of the beta_bandit arm played at the last loss: packets acked
+ * since then per jiffy, against loss_cwnd per srtt
+ *
+ * ssthresh cannot tell an RTO from a fast retransmit, tcp_enter_loss()
+ * calls it before CA_EVENT_LOSS and TCP_CA_Loss. So the pay is only
+ * held in bandit_held here: bictcp_cwnd_event(CA_EVENT_LOSS) turns it
+ * into 0, the next state change (TCP_CA_Recovery, TCP_CA_CWR) pays it.
+ */
+static void tcp_pred_bandit_hold(const struct sock *sk, struct bictcp *ca)
+{
+    const struct tcp_sock *tp = tcp_sk(sk);
+    u32 arm = (ca->flags & TCP_PRED_F_ARM) >> TCP_PRED_F_ARM_SHIFT;
+    u32 elapsed = tcp_time_stamp - ca->last_loss_time;
+    u64 num, den;
+
+    if (!arm)
+        return;
+    ca->flags &= ~TCP_PRED_F_ARM;
+    if (!elapsed || !ca->loss_cwnd || !tp->mss_cache)
+        return;
+    num = (u64)((tp->snd_una - ca->bandit_una) / tp->mss_cache) * tp->srtt
+        << (BANDIT_REWARD_SHIFT - 3);
+    den = (u64)elapsed * ca->loss_cwnd;
+    while (den >> 32) {
+        num >>= 1;
+        den >>= 1;
+    }
+    num = div_u64(num, (u32)den);
+    ca->bandit_held = arm << TCP_PRED_HELD_ARM_SHIFT | min_t(u64, num, BANDIT_REWARD_MAX);
+}
+
+/* pay what tcp_pred_bandit_hold() held back, nothing after an RTO */
+static void tcp_pred_bandit_pay(struct tcp_pred_net *tn, struct bictcp *ca, bool rto)
+{
+    u32 held = ca->bandit_held;
+
+    if (!held)
+        return;
+    ca->bandit_held = 0;
+    tcp_pred_bandit_update(tn, tcp_pred_bandit_context(ca, 2),
+                           (held >> TCP_PRED_HELD_ARM_SHIFT) - 1,
+                           rto ? 0 : held & TCP_PRED_HELD_REWARD);
+}
+
+/* the beta of this loss, ca->beta unless the bandit picks an arm */
+static u32 tcp_pred_bandit_beta(struct tcp_pred_net *tn, const struct sock *sk,
+                                struct bictcp *ca, u32 ctx)
+{
+    u32 arm, greedy;
+
+    if (!tn->beta_bandit)
+        return ca->beta;
+    spin_lock_bh(&tn->bandit_lock);
+    arm = bandit_select(&tn->bandit, ctx);
+    greedy = arm;
+    if (tn->bandit.pulls[ctx][arm]) {
+        /* whether UCB overruled the best mean */
+        u32 a;
+
+        for (a = 0; a < BANDIT_ARMS; a++)
+            if (tn->bandit.reward[ctx][a] > tn->bandit.reward[ctx][greedy])
+                greedy = a;
+    }
+    spin_unlock_bh(&tn->bandit_lock);
+    if (arm != greedy)
+        TCP_PRED_INC_STATS(tn, TCP_PRED_STAT_BANDIT_EXPLORE);
+    ca->flags |= (arm + 1) << TCP_PRED_F_ARM_SHIFT;
+    ca->bandit_una = tcp_sk(sk)->snd_una;
+    return bandit_beta(ca->beta, arm);
+}
+
 static u32 bictcp_recalc_ssthresh(struct sock *sk)
 {
     const struct tcp_sock *tp = tcp_sk(sk);
     struct bictcp *ca = inet_csk_ca(sk);
+    struct tcp_pred_net *tn = tcp_pred_net(sk);
+    struct tcp_pred_model *m = ca->model;
+    struct tcp_pred_sample sample = {
+        .elapsed = tcp_time_stamp - ca->last_loss_time,
+        .srtt    = tp->srtt,
+        .cwnd    = tp->snd_cwnd,
+    };
     u16 port=0;
     u32 buf_last_max_cwnd, prediction;
+    u32 ssthresh = 0, md_beta = ca->beta;
+    struct tcp_pred_hist hist;
+    s64 target[HIS_LEN];
+    cycles_t start;
     ca->epoch_start = 0;	/* end of epoch */
+    TCP_PRED_INC_STATS(tn, TCP_PRED_STAT_LOSS);
 
 
     //store last_max_cwnd
@@ -375,54 +1069,139 @@ static u32 bictcp_recalc_ssthresh(struct sock *sk)
     }else{
         printk("[L%d]%d %d %d %d %d 1\n", port, tcp_time_stamp - ca->last_loss_time, tp->srtt, ca->last_max_cwnd, tp->snd_ssthresh, ca->loss_cwnd);
     }
+    if(trace)
+        tcp_pred_trace_loss(tn, sk, tcp_time_stamp - ca->last_loss_time,
+                            tp->snd_cwnd >= ca->last_max_cwnd);
+
+    //a Wmax prediction is a hit if this loss came within 1/8 of it
+    if(ca->flags & TCP_PRED_F_WMAX){
+        tcp_pred_score(tn, ca, abs((s32)(tp->snd_cwnd - buf_last_max_cwnd))
+                           <= (s32)(tp->snd_cwnd >> 3));
+        ca->flags &= ~TCP_PRED_F_WMAX;
+    }
+    //kalmanはPRED_HOLT以外のどのpred_modeでも毎loss更新する(sysctlの切り替えにすぐ追従できる)
+    //holtとは場所を共有するので、切り替わったら新しい方を0から始める
+    if((tn->pred_mode == PRED_HOLT) != !!(ca->flags & TCP_PRED_F_HOLT)){
+        memset(&ca->kalman, 0, sizeof(ca->kalman));
+        ca->flags ^= TCP_PRED_F_HOLT;
+    }
+    if(ca->flags & TCP_PRED_F_HOLT)
+        holt_update(&ca->holt, tp->snd_cwnd, sample.elapsed);
+    else
+        kalman_update(&ca->kalman, tp->snd_cwnd);
+    ca->wmax_sd = 0;
+    //前のlossで選んだbetaの報酬(RTOかどうか分かるまで保留)、次のbetaを選ぶ
+    tcp_pred_bandit_hold(sk, ca);
+    if (tp->snd_cwnd > ca->low_window)
+        md_beta = tcp_pred_bandit_beta(tn, sk, ca,
+                                       bandit_context(sample.elapsed, sample.srtt, sample.cwnd));
 
     /* Wmax and fast convergence */
-    if(ca->ready == 0){ //loss履歴が十分でない場合予測しない
-        if (tp->snd_cwnd < ca->last_max_cwnd && fast_convergence)
-            ca->last_max_cwnd = (tp->snd_cwnd * (BICTCP_BETA_SCALE + beta))
+    if(!(ca->flags & TCP_PRED_F_READY) || !tcp_pred_confident(tn, ca)){ //loss履歴が十分でない場合予測しない
+        if (tp->snd_cwnd < ca->last_max_cwnd && tn->fast_convergence)
+            ca->last_max_cwnd = (tp->snd_cwnd * (BICTCP_BETA_SCALE + ca->beta))
                 / (2 * BICTCP_BETA_SCALE);
         else
             ca->last_max_cwnd = tp->snd_cwnd;
+    }else if(tn->pred_mode == PRED_KALMAN){
+        ca->last_max_cwnd = kalman_wmax(&ca->kalman, tp->snd_cwnd);
+        ca->wmax_sd = min_t(u32, kalman_sd(&ca->kalman), ca->last_max_cwnd >> 2);
+        ca->flags |= TCP_PRED_F_WMAX;
+        ssthresh = tcp_pred_wmax_ssthresh(ca, tp->snd_cwnd, md_beta);
+    }else if(tn->pred_mode == PRED_HOLT){
+        //time to the loss is looked up by bictcp_update() while TCP_PRED_F_WMAX is set
+        ca->last_max_cwnd = holt_wmax(&ca->holt, tp->snd_cwnd);
+        ca->flags |= TCP_PRED_F_WMAX;
+        ssthresh = tcp_pred_wmax_ssthresh(ca, tp->snd_cwnd, md_beta);
     }else{
         //loss履歴が十分な場合
-        train(ca);
-        prediction = get_prediction(tcp_time_stamp - ca->last_loss_time,
-                                           tp->srtt,
-                                           tp->snd_cwnd);
+        //学習はrecovery終了(TCP_CA_Open)まで遅らせ、1 RTT以内のlossはまとめる
+        //trainのないmodel(markov)はobserveだけで学習する
+        if(m->ops->train){
+            if((ca->flags & TCP_PRED_F_TRAIN_PENDING) &&
+               tcp_time_stamp - ca->last_loss_time > (tp->srtt >> 3)){
+                //前のepisodeがOpenに戻らずに終わった
+                tcp_pred_train(tn, ca);
+            }
+            if(ca->flags & TCP_PRED_F_TRAIN_PENDING){
+                TCP_PRED_INC_STATS(tn, TCP_PRED_STAT_TRAIN_BATCHED);
+            }else if(tcp_pred_need_train(tn, ca, tp->srtt, tp->snd_cwnd)){
+                ca->flags |= TCP_PRED_F_TRAIN_PENDING;
+            }else{
+                TCP_PRED_INC_STATS(tn, TCP_PRED_STAT_TRAIN_SKIP);
+            }
+        }
+
+        tcp_pred_hist(tn, ca, &hist, target);
+        sample.hist = &hist;
+        tcp_pred_model_lock(m);
+        start = get_cycles();
+        prediction = m->ops->predict(m->priv, ca->model_flow, &sample);
+        tcp_pred_hist_add(tn, TCP_PRED_HIST_PREDICT, start);
+        tcp_pred_model_unlock(m);
+        TCP_PRED_INC_STATS(tn, TCP_PRED_STAT_PREDICT);
         printk("[tcp_pred] packet lossed predction = %d\n", prediction);
-        if(prediction < (1 << (GAMMA - 1))){
-            ca->last_max_cwnd = (tp->snd_cwnd * (BICTCP_BETA_SCALE + beta))
-                / (2 * BICTCP_BETA_SCALE);
+        //labelしか出さないmodelはPRED_WMAXでもlabelとして使う
+        if(tcp_pred_wmax_model(tn, m)){
+            ca->last_max_cwnd = wmax_from_prediction(tp->snd_cwnd, prediction);
+            ca->flags |= TCP_PRED_F_WMAX;
+            ssthresh = tcp_pred_wmax_ssthresh(ca, tp->snd_cwnd, md_beta);
         }else{
-            ca->last_max_cwnd = tp->snd_cwnd;
+            //predicted label against the label of this loss
+            tcp_pred_score(tn, ca, (prediction >= (1 << (TCP_PRED_ONE_SHIFT - 1)))
+                               == (tp->snd_cwnd >= buf_last_max_cwnd));
+            if(prediction < (1 << (TCP_PRED_ONE_SHIFT - 1))){
+                ca->last_max_cwnd = (tp->snd_cwnd * (BICTCP_BETA_SCALE + ca->beta))
+                    / (2 * BICTCP_BETA_SCALE);
+            }else{
+                ca->last_max_cwnd = tp->snd_cwnd;
+            }
         }
     }
     //default action
     ca->loss_cwnd = tp->snd_cwnd;
+    if(m->ops->observe){
+        sample.label = tp->snd_cwnd >= buf_last_max_cwnd;
+        tcp_pred_model_lock(m);
+        m->ops->observe(m->priv, ca->model_flow, &sample);
+        tcp_pred_model_unlock(m);
+    }
     //index番目にloss状況を記録
-    ca->elapsed[ca->index] = tcp_time_stamp - ca->last_loss_time;
-    ca->rtt[ca->index] = tp->srtt;
-    ca->cwnd[ca->index] = tp->snd_cwnd;
+    ca->elapsed[ca->index] = fixp_u16f_encode(tcp_time_stamp - ca->last_loss_time);
+    ca->rtt[ca->index] = fixp_u16f_encode(tp->srtt);
+    ca->cwnd[ca->index] = fixp_u16f_encode(tp->snd_cwnd);
     if(tp->snd_cwnd < buf_last_max_cwnd){
-        ca->answer[ca->index] = 0;
+        ca->answers &= ~(1U << ca->index);
+        TCP_PRED_INC_STATS(tn, TCP_PRED_STAT_LABEL0);
     }else{
-        ca->answer[ca->index] = 1;
+        ca->answers |= 1U << ca->index;
+        TCP_PRED_INC_STATS(tn, TCP_PRED_STAT_LABEL1);
     }
 
     //indexを1つ進める
     ca->index++;
     if(ca->index == HIS_LEN){
-        if(ca->ready == 0){
-            ca->ready = 1;
-        }
+        ca->flags |= TCP_PRED_F_READY;
         ca->index = 0;
     }
     ca->last_loss_time = tcp_time_stamp;
 
-    if (tp->snd_cwnd <= low_window)
+    if (tp->snd_cwnd <= ca->low_window)
         return max(tp->snd_cwnd >> 1U, 2U);
+    else if (ssthresh)
+        return max(ssthresh, 2U);
     else
-        return max((tp->snd_cwnd * beta) / BICTCP_BETA_SCALE, 2U);
+        return max((tp->snd_cwnd * md_beta) / BICTCP_BETA_SCALE, 2U);
+}
+
+static void bictcp_release(struct sock *sk)
+{
+    struct bictcp *ca = inet_csk_ca(sk);
+
+    /* also called on sockets whose bictcp_init() never ran */
+    if (tcp_pred_model_owned(sk, ca))
+        tcp_pred_model_put(ca->model);
+    ca->model = NULL;
 }
 
 static u32 bictcp_undo_cwnd(struct sock *sk)
@@ -434,8 +1213,37 @@ static u32 bictcp_undo_cwnd(struct sock *sk)
 
 static void bictcp_state(struct sock *sk, u8 new_state)
 {
-    if (new_state == TCP_CA_Loss)
-        bictcp_reset(inet_csk_ca(sk));
+    struct bictcp *ca = inet_csk_ca(sk);
+
+    if (new_state == TCP_CA_Loss) {
+        struct tcp_pred_net *tn = tcp_pred_net(sk);
+        u32 arm = (ca->flags & TCP_PRED_F_ARM) >> TCP_PRED_F_ARM_SHIFT;
+
+        tcp_pred_bandit_pay(tn, ca, true);
+        //ssthresh無しのRTO(RTOの繰り返し)、前のlossで選んだbetaが負け
+        if (arm)
+            tcp_pred_bandit_update(tn, tcp_pred_bandit_context(ca, 1), arm - 1, 0);
+        bictcp_reset(ca);
+        return;
+    }
+    tcp_pred_bandit_pay(tcp_pred_net(sk), ca, false);
+    if (new_state == TCP_CA_Open && (ca->flags & TCP_PRED_F_TRAIN_PENDING))
+        tcp_pred_train(tcp_pred_net(sk), ca);
+}
+
+/*
+ * tcp_enter_loss() raises CA_EVENT_LOSS right after ssthresh: the held
+ * arm ended its epoch in an RTO, and the arm ssthresh just picked is
+ * not pulled, the Loss state throws its ssthresh away
+ */
+static void bictcp_cwnd_event(struct sock *sk, enum tcp_ca_event event)
+{
+    struct bictcp *ca = inet_csk_ca(sk);
+
+    if (event == CA_EVENT_LOSS) {
+        tcp_pred_bandit_pay(tcp_pred_net(sk), ca, true);
+        ca->flags &= ~TCP_PRED_F_ARM;
+    }
 }
 
 /* Track delayed acknowledgment ratio using sliding window
@@ -455,24 +1263,417 @@ static void bictcp_acked(struct sock *sk, u32 cnt, s32 rtt)
 
 static struct tcp_congestion_ops bictcp = {
     .init		= bictcp_init,
+    .release	= bictcp_release,
     .ssthresh	= bictcp_recalc_ssthresh,
     .cong_avoid	= bictcp_cong_avoid,
     .set_state	= bictcp_state,
+    .cwnd_event	= bictcp_cwnd_event,
     .undo_cwnd	= bictcp_undo_cwnd,
     .pkts_acked = bictcp_acked,
     .owner		= THIS_MODULE,
     .name		= "tcp_pred",
 };
 
+static int tcp_pred_stats_show(struct seq_file *seq, void *v)
+{
+    const struct tcp_pred_net *tn = tcp_pred_pernet(seq->private);
+    u64 cnt[__TCP_PRED_STAT_MAX] = { 0 };
+    u64 hist[__TCP_PRED_HIST_MAX][TCP_PRED_HIST_BUCKETS] = { { 0 } };
+    int cpu, i, b;
+
+    for_each_possible_cpu(cpu) {
+        const struct tcp_pred_stats *st = per_cpu_ptr(tn->stats, cpu);
+
+        for (i = 0; i < __TCP_PRED_STAT_MAX; i++)
+            cnt[i] += st->cnt[i];
+        for (i = 0; i < __TCP_PRED_HIST_MAX; i++)
+            for (b = 0; b < TCP_PRED_HIST_BUCKETS; b++)
+                hist[i][b] += st->hist[i][b];
+    }
+
+    for (i = 0; i < __TCP_PRED_STAT_MAX; i++)
+        seq_printf(seq, "%s %llu\n", tcp_pred_stat_names[i], cnt[i]);
+    if (cnt[TCP_PRED_STAT_HIT] + cnt[TCP_PRED_STAT_MISS])
+        seq_printf(seq, "accuracy %llu%%\n",
+                   div64_u64(cnt[TCP_PRED_STAT_HIT] * 100,
+                             cnt[TCP_PRED_STAT_HIT] + cnt[TCP_PRED_STAT_MISS]));
+
+    /* one row per non-empty bucket, "<2^b" is the upper bound in cycles */
+    seq_puts(seq, "cycles");
+    for (i = 0; i < __TCP_PRED_HIST_MAX; i++)
+        seq_printf(seq, " %s", tcp_pred_hist_names[i]);
+    seq_putc(seq, '\n');
+    for (b = 0; b < TCP_PRED_HIST_BUCKETS; b++) {
+        for (i = 0; i < __TCP_PRED_HIST_MAX; i++)
+            if (hist[i][b])
+                break;
+        if (i == __TCP_PRED_HIST_MAX)
+            continue;
+        seq_printf(seq, "<2^%d", b);
+        for (i = 0; i < __TCP_PRED_HIST_MAX; i++)
+            seq_printf(seq, " %llu", hist[i][b]);
+        seq_putc(seq, '\n');
+    }
+
+    /* the played contexts, pulls and mean reward (1024 = the rate before the loss) per arm */
+    for (i = 0; i < BANDIT_CTX; i++) {
+        for (b = 0; b < BANDIT_ARMS; b++)
+            if (tn->bandit.pulls[i][b])
+                break;
+        if (b == BANDIT_ARMS)
+            continue;
+        seq_printf(seq, "bandit %d", i);
+        for (b = 0; b < BANDIT_ARMS; b++)
+            seq_printf(seq, " %u/%u", tn->bandit.pulls[i][b], tn->bandit.reward[i][b]);
+        seq_putc(seq, '\n');
+    }
+    return 0;
+}
+
+static int tcp_pred_stats_open(struct inode *inode, struct file *file)
+{
+    return single_open_net(inode, file, tcp_pred_stats_show);
+}
+
+static const struct file_operations tcp_pred_stats_fops = {
+    .owner   = THIS_MODULE,
+    .open    = tcp_pred_stats_open,
+    .read    = seq_read,
+    .llseek  = seq_lseek,
+    .release = single_release_net,
+};
+
+/* blocking read of whole records, like /proc/kmsg */
+static ssize_t tcp_pred_trace_read(struct file *file, char __user *buf,
+                                   size_t count, loff_t *ppos)
+{
+    unsigned int copied;
+    int ret;
+
+    if (count < sizeof(struct tcp_pred_trace_rec))
+        return -EINVAL;
+    if (kfifo_is_empty(&tcp_pred_trace_fifo)) {
+        if (file->f_flags & O_NONBLOCK)
+            return -EAGAIN;
+        ret = wait_event_interruptible(tcp_pred_trace_wait,
+                                       !kfifo_is_empty(&tcp_pred_trace_fifo));
+        if (ret)
+            return ret;
+    }
+    if (mutex_lock_interruptible(&tcp_pred_trace_mutex))
+        return -ERESTARTSYS;
+    ret = kfifo_to_user(&tcp_pred_trace_fifo, buf, count, &copied);
+    mutex_unlock(&tcp_pred_trace_mutex);
+    return ret ? ret : copied;
+}
+
+static const struct file_operations tcp_pred_trace_fops = {
+    .owner   = THIS_MODULE,
+    .open    = nonseekable_open,
+    .read    = tcp_pred_trace_read,
+    .llseek  = no_llseek,
+};
+
+static int zero;
+static int one = 1;
+static int beta_max = BICTCP_BETA_SCALE;
+static int u16_max = 65535;
+static int pred_mode_max = PRED_HOLT;
+static int confidence_max = 255;
+
+/* .data is the offset in struct tcp_pred_net until the table is copied */
+#define TCP_PRED_SYSCTL(field, min, max) {                              \
+        .procname     = #field,                                         \
+        .data         = (void *)offsetof(struct tcp_pred_net, field),   \
+        .maxlen       = FIELD_SIZEOF(struct tcp_pred_net, field),       \
+        .mode         = 0644,                                           \
+        .proc_handler = proc_dointvec_minmax,                           \
+        .extra1       = min,                                            \
+        .extra2       = max,                                            \
+    }
+
+/* like net.ipv4.tcp_congestion_control */
+static int proc_tcp_pred_model(struct ctl_table *table, int write,
+                               void __user *buffer, size_t *lenp, loff_t *ppos)
+{
+    struct tcp_pred_net *tn = container_of(table->data, struct tcp_pred_net, model);
+    char val[TCP_PRED_MODEL_NAME_MAX];
+    struct ctl_table tbl = {
+        .data   = val,
+        .maxlen = TCP_PRED_MODEL_NAME_MAX,
+    };
+    struct tcp_pred_model *m;
+    int ret;
+
+    mutex_lock(&tcp_pred_model_mutex);
+    m = rcu_dereference_protected(tn->model, lockdep_is_held(&tcp_pred_model_mutex));
+    strlcpy(val, m->ops->name, sizeof(val));
+    ret = proc_dostring(&tbl, write, buffer, lenp, ppos);
+    if (write && ret == 0)
+        ret = tcp_pred_model_set(tn, &tn->model, val);
+    mutex_unlock(&tcp_pred_model_mutex);
+    return ret;
+}
+
+/* TC_PRIO_MAX + 1 names as for prio_beta, "-" for the namespace's model */
+#define TCP_PRED_PRIO_MODEL_LEN ((TC_PRIO_MAX + 1) * TCP_PRED_MODEL_NAME_MAX)
+
+static int proc_tcp_pred_prio_model(struct ctl_table *table, int write,
+                                    void __user *buffer, size_t *lenp, loff_t *ppos)
+{
+    struct tcp_pred_net *tn = container_of(table->data, struct tcp_pred_net, prio_model);
+    struct ctl_table tbl = {
+        .maxlen = TCP_PRED_PRIO_MODEL_LEN,
+    };
+    struct tcp_pred_model *m;
+    char *buf, *p, *name;
+    int i, n = 0, ret;
+
+    buf = kmalloc(TCP_PRED_PRIO_MODEL_LEN, GFP_KERNEL);
+    if (!buf)
+        return -ENOMEM;
+    tbl.data = buf;
+
+    mutex_lock(&tcp_pred_model_mutex);
+    for (i = 0; i <= TC_PRIO_MAX; i++) {
+        m = rcu_dereference_protected(tn->prio_model[i],
+                                      lockdep_is_held(&tcp_pred_model_mutex));
+        n += snprintf(buf + n, TCP_PRED_PRIO_MODEL_LEN - n, "%s%s",
+                      i ? " " : "", m ? m->ops->name : "-");
+    }
+    ret = proc_dostring(&tbl, write, buffer, lenp, ppos);
+    if (write && ret == 0) {
+        /* the priorities not written keep their model */
+        p = buf;
+        i = 0;
+        while (i <= TC_PRIO_MAX && (name = strsep(&p, " \t")) != NULL) {
+            if (!*name)
+                continue;
+            ret = tcp_pred_model_set(tn, &tn->prio_model[i++], name);
+            if (ret)
+                break;
+        }
+    }
+    mutex_unlock(&tcp_pred_model_mutex);
+    kfree(buf);
+    return ret;
+}
+
+static struct ctl_table tcp_pred_sysctl_table[] = {
+    TCP_PRED_SYSCTL(fast_convergence, &zero, &one),
+    TCP_PRED_SYSCTL(max_increment, &one, &u16_max),
+    TCP_PRED_SYSCTL(low_window, &zero, &u16_max),
+    TCP_PRED_SYSCTL(beta, &zero, &beta_max),
+    TCP_PRED_SYSCTL(initial_ssthresh, NULL, NULL),
+    TCP_PRED_SYSCTL(smooth_part, &zero, &u16_max),
+    TCP_PRED_SYSCTL(pred_mode, &zero, &pred_mode_max),
+    TCP_PRED_SYSCTL(min_confidence, &zero, &confidence_max),
+    TCP_PRED_SYSCTL(adaptive_train, &zero, &one),
+    TCP_PRED_SYSCTL(beta_bandit, &zero, &one),
+    TCP_PRED_SYSCTL(prio_beta, &zero, &beta_max),
+    TCP_PRED_SYSCTL(prio_max_increment, &zero, &u16_max),
+    TCP_PRED_SYSCTL(prio_low_window, &zero, &u16_max),
+    TCP_PRED_SYSCTL(prio_smooth_part, &zero, &u16_max),
+    {
+        .procname     = "model",
+        .data         = (void *)offsetof(struct tcp_pred_net, model),
+        .maxlen       = TCP_PRED_MODEL_NAME_MAX,
+        .mode         = 0644,
+        .proc_handler = proc_tcp_pred_model,
+    },
+    {
+        .procname     = "prio_model",
+        .data         = (void *)offsetof(struct tcp_pred_net, prio_model),
+        .maxlen       = TCP_PRED_PRIO_MODEL_LEN,
+        .mode         = 0644,
+        .proc_handler = proc_tcp_pred_prio_model,
+    },
+    { }
+};
+
+static int __net_init tcp_pred_net_init(struct net *net)
+{
+    struct tcp_pred_net *tn;
+    struct tcp_pred_model *m;
+    struct ctl_table *table;
+    int i;
+
+    tn = kmem_cache_zalloc(tcp_pred_net_cachep, GFP_KERNEL);
+    if (!tn)
+        goto out;
+    tn->stats = alloc_percpu(struct tcp_pred_stats);
+    if (!tn->stats)
+        goto out_tn;
+
+    tn->fast_convergence = fast_convergence;
+    tn->max_increment = clamp(max_increment, 1, 65535);
+    tn->low_window = clamp(low_window, 0, 65535);
+    tn->beta = clamp(beta, 0, BICTCP_BETA_SCALE);
+    tn->initial_ssthresh = initial_ssthresh;
+    tn->smooth_part = clamp(smooth_part, 0, 65535);
+    tn->pred_mode = pred_mode;
+    tn->min_confidence = min_confidence;
+    tn->adaptive_train = adaptive_train;
+    tn->beta_bandit = beta_bandit;
+    spin_lock_init(&tn->bandit_lock);
+
+    m = tcp_pred_model_create(model);
+    if (IS_ERR(m)) {
+        printk(KERN_WARNING "tcp_pred: model %s: %ld, using %s\n",
+               model, PTR_ERR(m), tcp_pred_perceptron.name);
+        m = tcp_pred_model_create(tcp_pred_perceptron.name);
+        if (IS_ERR(m))
+            goto out_stats;
+    }
+    RCU_INIT_POINTER(tn->model, m);
+
+    table = kmemdup(tcp_pred_sysctl_table, sizeof(tcp_pred_sysctl_table), GFP_KERNEL);
+    if (!table)
+        goto out_model;
+    for (i = 0; i < ARRAY_SIZE(tcp_pred_sysctl_table) - 1; i++)
+        table[i].data = (char *)tn + (unsigned long)table[i].data;
+    tn->sysctl = register_net_sysctl(net, "net/tcp_pred", table);
+    if (!tn->sysctl)
+        goto out_table;
+
+    *(struct tcp_pred_net **)net_generic(net, tcp_pred_net_id) = tn;
+    if (!proc_create("tcp_pred_stats", S_IRUGO, net->proc_net,
+                     &tcp_pred_stats_fops))
+        goto out_sysctl;
+    return 0;
+
+out_sysctl:
+    unregister_net_sysctl_table(tn->sysctl);
+out_table:
+    kfree(table);
+out_model:
+    tcp_pred_model_put(m);
+out_stats:
+    free_percpu(tn->stats);
+out_tn:
+    kmem_cache_free(tcp_pred_net_cachep, tn);
+out:
+    return -ENOMEM;
+}
+
+static void __net_exit tcp_pred_net_exit(struct net *net)
+{
+    struct tcp_pred_net *tn = tcp_pred_pernet(net);
+    struct ctl_table *table = tn->sysctl->ctl_table_arg;
+    struct tcp_pred_model *m;
+    int i;
+
+    remove_proc_entry("tcp_pred_stats", net->proc_net);
+    unregister_net_sysctl_table(tn->sysctl);
+    kfree(table);
+    /* the sysctl is gone, nothing else changes the slots */
+    for (i = 0; i <= TC_PRIO_MAX; i++) {
+        m = rcu_dereference_protected(tn->prio_model[i], 1);
+        if (m)
+            tcp_pred_model_put(m);
+    }
+    tcp_pred_model_put(rcu_dereference_protected(tn->model, 1));
+    free_percpu(tn->stats);
+    kmem_cache_free(tcp_pred_net_cachep, tn);
+}
+
+static struct pernet_operations tcp_pred_net_ops = {
+    .init = tcp_pred_net_init,
+    .exit = tcp_pred_net_exit,
+    .id   = &tcp_pred_net_id,
+    .size = sizeof(struct tcp_pred_net *),
+};
+
 static int __init bictcp_register(void)
 {
-    BUILD_BUG_ON(sizeof(struct bictcp) > ICSK_CA_PRIV_SIZE);
-    return tcp_register_congestion_control(&bictcp);
+    int ret = -ENOMEM;
+
+    BUILD_BUG_ON(sizeof(struct bictcp) + TCP_PRED_CA_HEADROOM > ICSK_CA_PRIV_SIZE);
+    BUILD_BUG_ON(offsetof(struct bictcp, last_loss_time) > L1_CACHE_BYTES);
+    BUILD_BUG_ON(HIS_LEN > 8 * FIELD_SIZEOF(struct bictcp, answers));
+    BUILD_BUG_ON(sizeof(struct tcp_pred_trace_rec) != TCP_PRED_TRACE_REC_SIZE);
+    BUILD_BUG_ON(GAMMA != TCP_PRED_ONE_SHIFT);
+    BUILD_BUG_ON((2 << MARKOV_ORDER) > 32); /* markov_flow.counters */
+    BUILD_BUG_ON(sizeof(struct ensemble_flow) > TCP_PRED_MODEL_FLOW_SIZE);
+    BUILD_BUG_ON(BANDIT_REWARD_MAX > TCP_PRED_HELD_REWARD);
+    BUILD_BUG_ON(sizeof(struct holt) > sizeof(struct wmax_kalman)); /* both memset as kalman */
+    /* a kmalloc()ed struct is not guaranteed to start on a cacheline */
+    tcp_pred_net_cachep = kmem_cache_create("tcp_pred_net", sizeof(struct tcp_pred_net),
+                                            0, SLAB_HWCACHE_ALIGN, NULL);
+    if (!tcp_pred_net_cachep)
+        goto out;
+    ret = tcp_pred_register_model(&tcp_pred_perceptron);
+    if (ret)
+        goto out_cache;
+    ret = tcp_pred_register_model(&tcp_pred_markov);
+    if (ret)
+        goto out_perceptron;
+    ret = tcp_pred_register_model(&tcp_pred_knn);
+    if (ret)
+        goto out_markov;
+    ret = tcp_pred_register_model(&tcp_pred_logistic);
+    if (ret)
+        goto out_knn;
+    ret = tcp_pred_register_model(&tcp_pred_stumps);
+    if (ret)
+        goto out_logistic;
+    ret = tcp_pred_register_model(&tcp_pred_rnn);
+    if (ret)
+        goto out_stumps;
+    ret = tcp_pred_register_model(&tcp_pred_ensemble);
+    if (ret)
+        goto out_rnn;
+    ret = register_pernet_subsys(&tcp_pred_net_ops);
+    if (ret)
+        goto out_model;
+    ret = -ENOMEM;
+    if (!proc_create("tcp_pred_trace", S_IRUSR, init_net.proc_net,
+                     &tcp_pred_trace_fops))
+        goto out_pernet;
+    ret = tcp_register_congestion_control(&bictcp);
+    if (ret)
+        goto out_trace;
+    return 0;
+
+out_trace:
+    remove_proc_entry("tcp_pred_trace", init_net.proc_net);
+out_pernet:
+    unregister_pernet_subsys(&tcp_pred_net_ops);
+    rcu_barrier();
+out_model:
+    tcp_pred_unregister_model(&tcp_pred_ensemble);
+out_rnn:
+    tcp_pred_unregister_model(&tcp_pred_rnn);
+out_stumps:
+    tcp_pred_unregister_model(&tcp_pred_stumps);
+out_logistic:
+    tcp_pred_unregister_model(&tcp_pred_logistic);
+out_knn:
+    tcp_pred_unregister_model(&tcp_pred_knn);
+out_markov:
+    tcp_pred_unregister_model(&tcp_pred_markov);
+out_perceptron:
+    tcp_pred_unregister_model(&tcp_pred_perceptron);
+out_cache:
+    kmem_cache_destroy(tcp_pred_net_cachep);
+out:
+    return ret;
 }
 
 static void __exit bictcp_unregister(void)
 {
     tcp_unregister_congestion_control(&bictcp);
+    remove_proc_entry("tcp_pred_trace", init_net.proc_net);
+    unregister_pernet_subsys(&tcp_pred_net_ops);
+    rcu_barrier(); /* tcp_pred_model_free() */
+    tcp_pred_unregister_model(&tcp_pred_ensemble);
+    tcp_pred_unregister_model(&tcp_pred_rnn);
+    tcp_pred_unregister_model(&tcp_pred_stumps);
+    tcp_pred_unregister_model(&tcp_pred_logistic);
+    tcp_pred_unregister_model(&tcp_pred_knn);
+    tcp_pred_unregister_model(&tcp_pred_markov);
+    tcp_pred_unregister_model(&tcp_pred_perceptron);
+    kmem_cache_destroy(tcp_pred_net_cachep);
 }
 
 module_init(bictcp_register);
@@ -0,0 +1,62 @@
+/*
+ * definitions shared by the tcp_pred module and the userspace tools
+ */
+#ifndef _TCP_PRED_H
+#define _TCP_PRED_H
+
+#include <linux/types.h>
+
+#define HIS_LEN 6 //number of teacher data
+
+/*
+ * per-flow confidence, an EWMA of prediction hits scaled to 0..255
+ * a flow starts at a coin flip. While below min_confidence it does not
+ * predict, and drifts up by CONF_PROBE per loss to try again later.
+ */
+#define CONF_INIT  128
+#define CONF_EWMA  3
+#define CONF_PROBE 4
+
+/*
+ * adaptive retraining
+ * a flow retrains only after a miss, or once srtt or cwnd moved more
+ * than 1/2^DRIFT_SHIFT away from their values at its last training
+ */
+#define DRIFT_SHIFT 2
+
+static inline int pred_drifted(u32 then, u32 now)
+{
+    u32 d = then > now ? then - now : now - then;
+
+    return d > (then >> DRIFT_SHIFT);
+}
+
+/*
+ * predictions and teacher data are in [0, 1 << TCP_PRED_ONE_SHIFT],
+ * a history entry with target TCP_PRED_NO_TARGET is not learned
+ */
+#define TCP_PRED_ONE_SHIFT 16
+#define TCP_PRED_NO_TARGET (-1)
+
+/*
+ * binary loss trace, read from /proc/net/tcp_pred_trace
+ *
+ * The file is a plain sequence of fixed-size records in host byte
+ * order, one per bictcp_recalc_ssthresh() call. These are the fields
+ * of the "[L<port>]" printk line plus the flow and the time.
+ */
+struct tcp_pred_trace_rec {
+    __u32 flow;      /* local port << 16 | remote port */
+    __u32 time;      /* tcp_time_stamp at the loss */
+    __u32 elapsed;   /* jiffies since the previous loss of this flow */
+    __u32 srtt;      /* tp->srtt, << 3 */
+    __u32 cwnd;      /* snd_cwnd at the loss */
+    __u32 ssthresh;  /* snd_ssthresh before the loss */
+    __u32 loss_cwnd; /* snd_cwnd at the previous loss */
+    __u8  label;     /* 0: below last_max_cwnd, 1: at or above */
+    __u8  pad[3];
+};
+
+#define TCP_PRED_TRACE_REC_SIZE 32
+
+#endif /* _TCP_PRED_H */
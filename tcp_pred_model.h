@@ -0,0 +1,78 @@
+/*
+ * predictor models for tcp_pred
+ *
+ * The congestion control keeps the loss history and decides what a
+ * prediction means (pred_mode); a model only maps a loss to a number
+ * in [0, 1 << TCP_PRED_ONE_SHIFT] and learns from the history. Models
+ * are registered like tcp_congestion_ops and picked by name through
+ * net.tcp_pred.model, or net.tcp_pred.prio_model per sk_priority.
+ *
+ * Each network namespace gets one instance of a model it uses, with
+ * priv_size bytes of zeroed state. Every flow gets flow_size bytes,
+ * zeroed when the flow starts and after an RTO. All hooks of an
+ * instance but init and release are serialized by the core, and run
+ * in softirq context, so they must not sleep. release may run from an
+ * RCU callback. A model with no priv_size only has per-flow state,
+ * which the socket lock already serializes, and is called unlocked.
+ * A model without train learns from observe alone.
+ *
+ * A prediction is a label (the loss reaches the previous Wmax) unless
+ * the model sets TCP_PRED_MODEL_WMAX: then, under pred_mode=1, it is
+ * the wmax_target() ratio, learnt from the targets train and predict
+ * get in the history. A label-only model under pred_mode=1 keeps
+ * predicting labels, the label picks fast convergence as in pred_mode=0.
+ */
+#ifndef _TCP_PRED_MODEL_H
+#define _TCP_PRED_MODEL_H
+
+#include <linux/list.h>
+#include <linux/module.h>
+#include "tcp_pred.h"
+
+#define TCP_PRED_MODEL_NAME_MAX  16
+#define TCP_PRED_MODEL_FLOW_SIZE 16 /* bytes of per-flow state in struct bictcp */
+
+/* the flow's HIS_LEN losses, a ring whose newest entry is at newest */
+struct tcp_pred_hist {
+    const u16 *elapsed; /* fixp_u16f codes */
+    const u16 *rtt;
+    const u16 *cwnd;
+    const s64 *target;  /* [0, 1 << TCP_PRED_ONE_SHIFT] or TCP_PRED_NO_TARGET */
+    u8 newest;
+};
+
+/* one loss */
+struct tcp_pred_sample {
+    u32 elapsed; /* jiffies since the previous loss of the flow */
+    u32 srtt;    /* tp->srtt, << 3 */
+    u32 cwnd;    /* snd_cwnd at the loss */
+    u32 label;   /* cwnd reached the previous Wmax, set for observe only */
+    const struct tcp_pred_hist *hist; /* the losses before it, for predict only */
+};
+
+struct tcp_pred_model_ops {
+    struct list_head list;
+    size_t priv_size;  /* state per namespace */
+    size_t flow_size;  /* state per flow, <= TCP_PRED_MODEL_FLOW_SIZE */
+    u32 flags;
+#define TCP_PRED_MODEL_WMAX 0x1 /* can predict the Wmax ratio, not only the label */
+
+    /* predict the loss being handled (required) */
+    u32 (*predict)(void *priv, void *flow, const struct tcp_pred_sample *s);
+    /* set up a new instance (optional) */
+    int (*init)(void *priv, u32 seed);
+    /* tear it down (optional) */
+    void (*release)(void *priv);
+    /* every loss of every flow, after predict if that ran (optional) */
+    void (*observe)(void *priv, void *flow, const struct tcp_pred_sample *s);
+    /* learn the flow's history (optional) */
+    void (*train)(void *priv, void *flow, const struct tcp_pred_hist *h);
+
+    char name[TCP_PRED_MODEL_NAME_MAX];
+    struct module *owner;
+};
+
+extern int tcp_pred_register_model(struct tcp_pred_model_ops *ops);
+extern void tcp_pred_unregister_model(struct tcp_pred_model_ops *ops);
+
+#endif /* _TCP_PRED_MODEL_H */
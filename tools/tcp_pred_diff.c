@@ -0,0 +1,508 @@
+/*
+ * tcp_pred_diff - fixed-point perceptron versus a double precision reference
+ *
+ *   tcp_pred_diff [-n cases] [-s seed] [-v] [-b] [trace...]
+ *
+ * Both networks start from the same random weights and are trained in
+ * lockstep on the same HIS_LEN samples, one train_epoch() at a time.
+ * The reference follows the same update rule as train(), only without
+ * the shifts, so every difference is quantization (or overflow) error.
+ *
+ * Without trace files the histories are random; with trace files every
+ * HIS_LEN consecutive losses of a flow form one case, and the next loss
+ * of the flow is the query, like in bictcp_recalc_ssthresh().
+ *
+ * Reported:
+ *   - distribution of |fixed - reference| of the final prediction
+ *   - label disagreements (the two sides of 1 << (GAMMA - 1))
+ *   - s64 overflows of Min/Nin (checked against 128 bit sums) and
+ *     sigmoid table clamps (modin outside [0, 1 << ALPHA))
+ *   - per-epoch mean/max output error, weight divergence and the
+ *     fraction of the training labels the fixed-point side gets right
+ *   - per-epoch gradient error: the rms of dlm/dmn minus the reference's,
+ *     relative to the rms of the reference's, for each layer. In epoch 1
+ *     both sides start from the same weights, and the rounding of the
+ *     inputs to 1/2^NORM_SHIFT accounts for 20-40% on grad_lm. A term
+ *     scaled wrong in train_epoch() reads ~100% even while the outputs
+ *     still agree
+ *   - with -b, ns per train()+get_prediction() for both sides
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "user.h"
+#include "tcp_pred.h"
+#include "perceptron.h"
+
+/* one training set plus the query that follows it, fixp_u16f codes like struct bictcp */
+struct diff_case {
+    u16 elapsed[HIS_LEN + 1];
+    u16 rtt[HIS_LEN + 1];
+    u16 cwnd[HIS_LEN + 1];
+    u8  answer[HIS_LEN + 1];
+};
+
+struct ref_param {
+    double wlm[L+1][M];
+    double wmn[M+1][N];
+    double dlm[L+1][M];
+    double dmn[M+1][N];
+    double Lout[L];
+    double Mout[M];
+    struct perceptron_norm norm;
+};
+
+/* |fixed - reference| buckets, in units of the output range [0, 1] */
+#define ERR_BUCKETS 8
+static const double err_limit[ERR_BUCKETS] = {
+    1.0 / 65536, 1.0 / 4096, 1.0 / 256, 1.0 / 64, 1.0 / 16, 1.0 / 4, 1.0 / 2, 2.0,
+};
+
+struct epoch_stat {
+    double err_sum;
+    double err_max;
+    double wdiv_sum;  /* rms weight difference, in real units */
+    double glm_diff, glm_ref; /* sums of squares of dlm - ref and of ref dlm */
+    double gmn_diff, gmn_ref;
+    u64 fit;          /* training samples classified right */
+};
+
+static u64 err_hist[ERR_BUCKETS];
+static u64 nr_cases, nr_disagree, nr_overflow, nr_clamp, nr_forward;
+static struct epoch_stat epoch[LOOP_MAX];
+static double fixed_ns, ref_ns;
+static int verbose, bench;
+
+static u64 now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* exact sigmoid at the table's scale: index i is z = (i - 2^(ALPHA-1)) / 4096 */
+static double ref_sigmoid(double z)
+{
+    return 1.0 / (1.0 + exp(-z));
+}
+
+/* norm_input() without the rounding, same statistics */
+static double ref_input(const struct perceptron_norm *n, int i, u32 x)
+{
+    double z = ((double)norm_sat(x) * (1 << NORM_FRAC) - n->mean[i]) * (1 << NORM_SHIFT) / n->mad[i];
+
+    if (z > NORM_CLAMP)
+        return NORM_CLAMP;
+    if (z < -NORM_CLAMP)
+        return -NORM_CLAMP;
+    return z;
+}
+
+/*
+ * get_prediction() computes modin = (sum >> shift) / BETA + 2^(ALPHA-1)
+ * with a table step of 1/4096, which works out to z = sum / 2 in real
+ * units for both layers.
+ */
+static double ref_prediction(struct ref_param *r, const struct diff_case *c, int k)
+{
+    double z;
+    int i, j;
+
+    r->Lout[0] = ref_input(&r->norm, 0, fixp_u16f_decode(c->elapsed[k]));
+    r->Lout[1] = ref_input(&r->norm, 1, fixp_u16f_decode(c->rtt[k]));
+    r->Lout[2] = ref_input(&r->norm, 2, fixp_u16f_decode(c->cwnd[k]));
+    for (i = 0; i < M; i++) {
+        z = -r->wlm[L][i];
+        for (j = 0; j < L; j++)
+            z += r->wlm[j][i] * r->Lout[j];
+        r->Mout[i] = ref_sigmoid(z / 2);
+    }
+    z = -r->wmn[M][0];
+    for (j = 0; j < M; j++)
+        z += r->wmn[j][0] * r->Mout[j];
+    return ref_sigmoid(z / 2);
+}
+
+static void ref_train_epoch(struct ref_param *r, const struct diff_case *c)
+{
+    double y, dk, dj;
+    int i, j, k;
+
+    memset(r->dlm, 0, sizeof(r->dlm));
+    memset(r->dmn, 0, sizeof(r->dmn));
+    for (i = 0; i < HIS_LEN; i++) {
+        y = ref_prediction(r, c, i);
+        dk = (c->answer[i] - y) * (1 - y) * y;
+        for (j = 0; j < M; j++)
+            r->dmn[j][0] += dk * r->Mout[j];
+        r->dmn[M][0] -= dk;
+        for (j = 0; j < M; j++) {
+            dj = dk * r->wmn[j][0] * r->Mout[j] * (1 - r->Mout[j]);
+            for (k = 0; k < L; k++)
+                r->dlm[k][j] += dj * r->Lout[k];
+            r->dlm[L][j] -= dj;
+        }
+    }
+    for (i = 0; i < L + 1; i++)
+        for (j = 0; j < M; j++)
+            r->wlm[i][j] += r->dlm[i][j] / (1 << ETA);
+    for (i = 0; i < M + 1; i++)
+        r->wmn[i][0] += r->dmn[i][0] / (1 << ETA);
+}
+
+static void ref_load(struct ref_param *r, const struct perceptron_param *p)
+{
+    int i, j;
+
+    for (i = 0; i < L + 1; i++)
+        for (j = 0; j < M; j++)
+            r->wlm[i][j] = (double)p->wlm[i][j] / (1 << DELTA);
+    for (i = 0; i < M + 1; i++)
+        r->wmn[i][0] = (double)p->wmn[i][0] / (1 << DELTA);
+    r->norm = p->norm;
+}
+
+/* statistics of the training set, as the module would have seen them */
+static void norm_load(struct perceptron_param *p, const struct diff_case *c)
+{
+    int i;
+
+    memset(&p->norm, 0, sizeof(p->norm));
+    for (i = 0; i < HIS_LEN; i++)
+        norm_update(&p->norm, fixp_u16f_decode(c->elapsed[i]),
+                    fixp_u16f_decode(c->rtt[i]), fixp_u16f_decode(c->cwnd[i]));
+}
+
+/* the training labels as struct bictcp keeps them */
+static u8 case_answers(const struct diff_case *c)
+{
+    u8 answers = 0;
+    int i;
+
+    for (i = 0; i < HIS_LEN; i++)
+        answers |= (c->answer[i] & 1U) << i;
+    return answers;
+}
+
+/* the gradients train_epoch() and ref_train_epoch() just summed, weight by weight */
+static void gradient_diff(struct epoch_stat *e, const struct ref_param *r,
+                          const struct perceptron_param *p)
+{
+    double d;
+    int i, j;
+
+    for (i = 0; i < L + 1; i++) {
+        for (j = 0; j < M; j++) {
+            d = (double)p->dlm[i][j] / (1 << DELTA) - r->dlm[i][j];
+            e->glm_diff += d * d;
+            e->glm_ref += r->dlm[i][j] * r->dlm[i][j];
+        }
+    }
+    for (i = 0; i < M + 1; i++) {
+        d = (double)p->dmn[i][0] / (1 << DELTA) - r->dmn[i][0];
+        e->gmn_diff += d * d;
+        e->gmn_ref += r->dmn[i][0] * r->dmn[i][0];
+    }
+}
+
+static double weight_divergence(const struct ref_param *r, const struct perceptron_param *p)
+{
+    double d, sum = 0;
+    int i, j;
+
+    for (i = 0; i < L + 1; i++) {
+        for (j = 0; j < M; j++) {
+            d = (double)p->wlm[i][j] / (1 << DELTA) - r->wlm[i][j];
+            sum += d * d;
+        }
+    }
+    for (i = 0; i < M + 1; i++) {
+        d = (double)p->wmn[i][0] / (1 << DELTA) - r->wmn[i][0];
+        sum += d * d;
+    }
+    return sqrt(sum / ((L + 1) * M + M + 1));
+}
+
+/* fixed-point forward pass plus overflow and clamp accounting */
+static s64 fixed_prediction(struct perceptron_param *p, const struct diff_case *c, int k)
+{
+    s64 result = get_prediction(p, fixp_u16f_decode(c->elapsed[k]),
+                                fixp_u16f_decode(c->rtt[k]), fixp_u16f_decode(c->cwnd[k]));
+    __int128 sum;
+    s64 modin;
+    int i, j;
+
+    nr_forward++;
+    for (i = 0; i < M; i++) {
+        sum = -(__int128)p->wlm[L][i];
+        for (j = 0; j < L; j++)
+            sum += (__int128)p->wlm[j][i] * p->Lout[j];
+        if (sum != p->Min[i])
+            nr_overflow++;
+        modin = (p->Min[i] >> (1 + DELTA - ALPHA)) / BETA + FIXP_HALF(ALPHA);
+        if (modin < 0 || modin >= (1 << ALPHA))
+            nr_clamp++;
+    }
+    sum = -(__int128)p->wmn[M][0];
+    for (j = 0; j < M; j++)
+        sum += (__int128)p->wmn[j][0] * p->Mout[j];
+    if (sum != p->Nin[0])
+        nr_overflow++;
+    modin = (p->Nin[0] >> (1 + GAMMA + DELTA - ALPHA)) / BETA + FIXP_HALF(ALPHA);
+    if (modin < 0 || modin >= (1 << ALPHA))
+        nr_clamp++;
+    return result;
+}
+
+static void run_case(const struct diff_case *c)
+{
+    struct perceptron_param p;
+    struct ref_param r;
+    s64 target[HIS_LEN];
+    double yf, yr, err;
+    int x, i, b;
+
+    label_targets(case_answers(c), target);
+    initialize_perceptron(&p, random32());
+    norm_load(&p, c);
+    ref_load(&r, &p);
+
+    for (x = 0; x < LOOP_MAX; x++) {
+        train_epoch(&p, c->elapsed, c->rtt, c->cwnd, target);
+        ref_train_epoch(&r, c);
+        gradient_diff(&epoch[x], &r, &p);
+        for (i = 0; i < HIS_LEN; i++) {
+            yf = (double)fixed_prediction(&p, c, i) / (1 << GAMMA);
+            yr = ref_prediction(&r, c, i);
+            err = fabs(yf - yr);
+            epoch[x].fit += (yf >= 0.5) == c->answer[i];
+            epoch[x].err_sum += err;
+            if (err > epoch[x].err_max)
+                epoch[x].err_max = err;
+        }
+        epoch[x].wdiv_sum += weight_divergence(&r, &p);
+    }
+
+    yf = (double)fixed_prediction(&p, c, HIS_LEN) / (1 << GAMMA);
+    yr = ref_prediction(&r, c, HIS_LEN);
+    err = fabs(yf - yr);
+    for (b = 0; b < ERR_BUCKETS - 1 && err >= err_limit[b]; b++)
+        ;
+    err_hist[b]++;
+    if ((yf >= 0.5) != (yr >= 0.5))
+        nr_disagree++;
+    nr_cases++;
+}
+
+static void bench_case(const struct diff_case *c)
+{
+    struct perceptron_param p;
+    struct ref_param r;
+    s64 target[HIS_LEN];
+    volatile double sink;
+    u64 t;
+    int x;
+
+    initialize_perceptron(&p, random32());
+    norm_load(&p, c);
+    t = now_ns();
+    label_targets(case_answers(c), target);
+    train(&p, c->elapsed, c->rtt, c->cwnd, target);
+    sink = get_prediction(&p, fixp_u16f_decode(c->elapsed[HIS_LEN]),
+                          fixp_u16f_decode(c->rtt[HIS_LEN]), fixp_u16f_decode(c->cwnd[HIS_LEN]));
+    fixed_ns += now_ns() - t;
+
+    t = now_ns();
+    ref_load(&r, &p);
+    for (x = 0; x < LOOP_MAX; x++)
+        ref_train_epoch(&r, c);
+    sink = ref_prediction(&r, c, HIS_LEN);
+    ref_ns += now_ns() - t;
+    (void)sink;
+}
+
+static void do_case(const struct diff_case *c)
+{
+    run_case(c);
+    if (bench)
+        bench_case(c);
+}
+
+/* raw inputs spread over 2^0 .. 2^24, past where NORM_X_MAX saturates */
+static void random_case(struct diff_case *c)
+{
+    int i;
+
+    for (i = 0; i < HIS_LEN + 1; i++) {
+        c->elapsed[i] = fixp_u16f_encode(random32() >> (8 + random32() % 24));
+        c->rtt[i] = fixp_u16f_encode(random32() >> (8 + random32() % 24));
+        c->cwnd[i] = random32() % 2048;
+        c->answer[i] = random32() & 1;
+    }
+}
+
+struct flow {
+    u32 key;
+    int n;
+    struct diff_case c;
+};
+
+/* every flow's losses, HIS_LEN + 1 at a time with a stride of one */
+static void trace_cases(const char *name, u64 max)
+{
+    const struct tcp_pred_trace_rec *rec;
+    struct flow *flows = NULL;
+    size_t nr, i, nr_flows = 0, f;
+    struct stat st;
+    void *m;
+    int fd, k;
+
+    fd = open(name, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        fprintf(stderr, "%s: %s\n", name, strerror(errno));
+        exit(1);
+    }
+    nr = st.st_size / sizeof(*rec);
+    if (!nr) {
+        close(fd);
+        return;
+    }
+    m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (m == MAP_FAILED) {
+        fprintf(stderr, "%s: %s\n", name, strerror(errno));
+        exit(1);
+    }
+    close(fd);
+    rec = m;
+
+    for (i = 0; i < nr && nr_cases < max; i++) {
+        struct diff_case *c;
+
+        for (f = 0; f < nr_flows && flows[f].key != rec[i].flow; f++)
+            ;
+        if (f == nr_flows) {
+            flows = realloc(flows, ++nr_flows * sizeof(*flows));
+            if (!flows) {
+                perror("realloc");
+                exit(1);
+            }
+            memset(&flows[f], 0, sizeof(flows[f]));
+            flows[f].key = rec[i].flow;
+        }
+        c = &flows[f].c;
+        if (flows[f].n == HIS_LEN + 1) {
+            for (k = 0; k < HIS_LEN; k++) {
+                c->elapsed[k] = c->elapsed[k + 1];
+                c->rtt[k] = c->rtt[k + 1];
+                c->cwnd[k] = c->cwnd[k + 1];
+                c->answer[k] = c->answer[k + 1];
+            }
+            flows[f].n--;
+        }
+        k = flows[f].n++;
+        c->elapsed[k] = fixp_u16f_encode(rec[i].elapsed);
+        c->rtt[k] = fixp_u16f_encode(rec[i].srtt);
+        c->cwnd[k] = fixp_u16f_encode(rec[i].cwnd);
+        c->answer[k] = rec[i].label;
+        if (flows[f].n == HIS_LEN + 1)
+            do_case(c);
+    }
+    free(flows);
+    munmap(m, st.st_size);
+}
+
+static void report(void)
+{
+    double n;
+    int b, x;
+
+    if (!nr_cases) {
+        printf("no cases\n");
+        return;
+    }
+    n = nr_cases;
+    printf("cases %llu, label disagreements %llu (%.2f%%)\n",
+           (unsigned long long)nr_cases, (unsigned long long)nr_disagree,
+           100.0 * nr_disagree / n);
+    printf("forward passes %llu, s64 overflows %llu, sigmoid clamps %llu (%.2f%% of units)\n",
+           (unsigned long long)nr_forward, (unsigned long long)nr_overflow,
+           (unsigned long long)nr_clamp, 100.0 * nr_clamp / (nr_forward * (M + N)));
+
+    printf("prediction error |fixed - ref|\n");
+    for (b = 0; b < ERR_BUCKETS; b++) {
+        if (b < ERR_BUCKETS - 1)
+            printf("  < %-10g", err_limit[b]);
+        else
+            printf("  >= %-9g", err_limit[b - 1]);
+        printf(" %10llu %6.2f%%\n", (unsigned long long)err_hist[b], 100.0 * err_hist[b] / n);
+    }
+
+    printf("epoch  mean_err   max_err    weight_rms  grad_lm  grad_mn  fit\n");
+    for (x = 0; x < LOOP_MAX; x++) {
+        if (!verbose && x % 10 != 9 && x != 0)
+            continue;
+        printf("%5d  %-9.6f  %-9.6f  %-9.6f   %6.2f%%  %6.2f%%  %.2f%%\n", x + 1,
+               epoch[x].err_sum / (n * HIS_LEN), epoch[x].err_max,
+               epoch[x].wdiv_sum / n,
+               epoch[x].glm_ref ? 100.0 * sqrt(epoch[x].glm_diff / epoch[x].glm_ref) : 0.0,
+               epoch[x].gmn_ref ? 100.0 * sqrt(epoch[x].gmn_diff / epoch[x].gmn_ref) : 0.0,
+               100.0 * epoch[x].fit / (n * HIS_LEN));
+    }
+
+    if (bench)
+        printf("train+predict: fixed %.0f ns, double %.0f ns per case\n",
+               fixed_ns / n, ref_ns / n);
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: tcp_pred_diff [-n cases] [-s seed] [-v] [-b] [trace...]\n");
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    struct diff_case c;
+    u64 max = 1000, i;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:s:vb")) != -1) {
+        switch (opt) {
+        case 'n':
+            max = strtoull(optarg, NULL, 0);
+            break;
+        case 's':
+            user_srandom(strtoul(optarg, NULL, 0));
+            break;
+        case 'v':
+            verbose = 1;
+            break;
+        case 'b':
+            bench = 1;
+            break;
+        default:
+            usage();
+        }
+    }
+
+    if (optind == argc) {
+        for (i = 0; i < max; i++) {
+            random_case(&c);
+            do_case(&c);
+        }
+    }
+    for (; optind < argc; optind++)
+        trace_cases(argv[optind], max);
+
+    report();
+    return 0;
+}
@@ -0,0 +1,520 @@
+/*
+ * tcp_pred_replay - feed captured loss traces back through the predictor
+ *
+ *   echo 1 > /sys/module/tcp_pred/parameters/trace
+ *   cat /proc/net/tcp_pred_trace > loss.trace
+ *   tcp_pred_replay [-j threads] [-s seed] [-w|-k|-H] [-c min_confidence] [-t]
+ *                   [-m model] loss.trace...
+ *
+ * Every trace file is mmap'd and scanned by all threads in order; a
+ * thread only replays the flows that hash to it, so the per-flow loss
+ * order is kept while the flows are spread over the cpus. Each flow
+ * goes through the same history/train()/get_prediction() sequence as
+ * bictcp_recalc_ssthresh(), and the predicted labels are scored
+ * against the recorded ones. With -w the regression head (pred_mode=1)
+ * is trained instead and its Wmax is scored against the cwnd of the
+ * flow's next loss, next to simply taking the current cwnd. -k scores
+ * the Kalman filter's Wmax (pred_mode=2) the same way, -H Holt's
+ * forecast (pred_mode=3) and also its time to the next loss, next to
+ * taking the last interval. Flows whose
+ * confidence is below -c (default CONF_INIT, as the module) skip both.
+ * Training follows adaptive_train unless -t asks for it on every loss.
+ * As in the module it is put off to the end of the recovery episode;
+ * the trace has no state changes, so a loss more than one srtt after
+ * the previous one stands for the return to TCP_CA_Open.
+ * -m picks the model as net.tcp_pred.model does, the time per loss is
+ * what the model costs: train(), get_prediction() and norm_update()
+ * for the perceptron, markov_predict() and markov_update() for markov,
+ * knn_predict() for knn, logistic_predict() and logistic_update() for
+ * logistic, stumps_predict() for stumps, rnn_predict() and
+ * rnn_update() for rnn, the perceptron's plus ensemble_predict() and
+ * ensemble_update() for ensemble, in ns and in get_cycles() units. Score stumps
+ * and rnn on traces other than those they were trained on.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "user.h"
+#include "tcp_pred.h"
+#include "perceptron.h"
+#include "markov.h"
+#include "kalman.h"
+#include "holt.h"
+#include "knn.h"
+#include "logistic.h"
+#include "stumps.h"
+#include "rnn.h"
+#include "rnn_gen.h"
+#include "ensemble.h"
+
+struct trace_file {
+    const char *name;
+    const struct tcp_pred_trace_rec *rec;
+    size_t nr;
+};
+
+/* per-flow state, the part of struct bictcp the predictor looks at */
+struct flow {
+    u32 key;
+    u8  used;
+    u8  index;
+    u8  ready;
+    u16 elapsed[HIS_LEN];
+    u16 rtt[HIS_LEN];
+    u16 cwnd[HIS_LEN];
+    u8  answers;
+    u8  confidence;
+    u8  missed;
+    u8  trained;
+    u8  pending;
+    u16 train_srtt;
+    u16 train_cwnd;
+    u32 wmax;    /* predicted at the previous loss, 0 if none */
+    u32 cwnd_prev;
+    struct markov_flow markov;
+    struct wmax_kalman kalman;
+    struct holt holt;
+    u32 interval;     /* holt_interval() at the previous loss, 0 if none */
+    u32 elapsed_prev;
+    struct rnn_flow rnn;
+    struct ensemble_flow ensemble;
+};
+
+struct shard {
+    pthread_t thread;
+    int id;
+    struct perceptron_param p;
+    struct logistic_param lr;
+    int p_trained;
+    struct flow *flows;    /* open addressing, size is a power of 2 */
+    size_t nr_slots;
+    size_t nr_flows;
+    u64 losses;
+    u64 predictions;
+    u64 hits;
+    u64 train_ns;
+    u64 train_cycles;
+    u64 trainings;
+    u64 gated;
+    u64 batched;
+    u64 wmax_scored;
+    double wmax_err;  /* sum of |predicted - actual| / actual */
+    double last_err;  /* same for the previous loss's cwnd */
+    u64 interval_scored;
+    double interval_err;      /* same for the time to the loss, -H */
+    double interval_last_err; /* and for the previous interval */
+};
+
+static struct trace_file *files;
+static int nr_files;
+static int nr_shards = 1;
+static u32 seed = 1;
+static int wmax_mode;
+static int kalman_mode;
+static int holt_mode;
+static int min_confidence = CONF_INIT;
+static int adaptive_train = 1;
+
+enum {
+    MODEL_PERCEPTRON,
+    MODEL_MARKOV,
+    MODEL_KNN,
+    MODEL_LOGISTIC,
+    MODEL_STUMPS,
+    MODEL_RNN,
+    MODEL_ENSEMBLE,
+};
+
+static const char * const model_names[] = {
+    [MODEL_PERCEPTRON] = "perceptron",
+    [MODEL_MARKOV]     = "markov",
+    [MODEL_KNN]        = "knn",
+    [MODEL_LOGISTIC]   = "logistic",
+    [MODEL_STUMPS]     = "stumps",
+    [MODEL_RNN]        = "rnn",
+    [MODEL_ENSEMBLE]   = "ensemble",
+};
+static int model = MODEL_PERCEPTRON;
+
+static inline u32 flow_hash(u32 key)
+{
+    return key * 2654435761U;
+}
+
+static u64 now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void cost_add(struct shard *sh, u64 t, u64 c)
+{
+    sh->train_cycles += get_cycles() - c;
+    sh->train_ns += now_ns() - t;
+}
+
+static struct flow *flow_lookup(struct shard *sh, u32 key)
+{
+    size_t i, mask;
+
+    if ((sh->nr_flows + 1) * 2 > sh->nr_slots) {
+        struct flow *old = sh->flows;
+        size_t n = sh->nr_slots;
+
+        sh->nr_slots = n ? n * 2 : 1024;
+        sh->flows = calloc(sh->nr_slots, sizeof(*sh->flows));
+        if (!sh->flows) {
+            perror("calloc");
+            exit(1);
+        }
+        mask = sh->nr_slots - 1;
+        for (i = 0; i < n; i++) {
+            size_t j;
+
+            if (!old[i].used)
+                continue;
+            for (j = flow_hash(old[i].key) & mask; sh->flows[j].used; j = (j + 1) & mask)
+                ;
+            sh->flows[j] = old[i];
+        }
+        free(old);
+    }
+
+    mask = sh->nr_slots - 1;
+    for (i = flow_hash(key) & mask; sh->flows[i].used; i = (i + 1) & mask)
+        if (sh->flows[i].key == key)
+            return &sh->flows[i];
+    sh->flows[i].used = 1;
+    sh->flows[i].key = key;
+    sh->flows[i].confidence = CONF_INIT;
+    sh->nr_flows++;
+    return &sh->flows[i];
+}
+
+static void score(struct shard *sh, struct flow *f, int hit)
+{
+    sh->hits += hit;
+    f->confidence += ((hit ? 255 : 0) - f->confidence) >> CONF_EWMA;
+    f->missed = !hit;
+}
+
+/* tcp_pred_need_train() */
+static int need_train(struct shard *sh, struct flow *f, u32 srtt, u32 cwnd)
+{
+    if (!adaptive_train || !sh->p_trained || f->missed || !f->trained)
+        return 1;
+    return pred_drifted(fixp_u16f_decode(f->train_srtt), srtt) ||
+           pred_drifted(fixp_u16f_decode(f->train_cwnd), cwnd);
+}
+
+/* tcp_pred_targets() */
+static void flow_targets(const struct flow *f, s64 *target)
+{
+    int i, newest = (f->index + HIS_LEN - 1) % HIS_LEN;
+
+    if (wmax_mode) {
+        for (i = 0; i < HIS_LEN; i++)
+            target[i] = i == newest ? TCP_PRED_NO_TARGET
+                : wmax_target(fixp_u16f_decode(f->cwnd[i]),
+                              fixp_u16f_decode(f->cwnd[(i + 1) % HIS_LEN]));
+    } else {
+        label_targets(f->answers, target);
+    }
+}
+
+/* tcp_pred_train() */
+static void deferred_train(struct shard *sh, struct flow *f)
+{
+    int newest = (f->index + HIS_LEN - 1) % HIS_LEN;
+    s64 target[HIS_LEN];
+    u64 t = now_ns(), c = get_cycles();
+
+    flow_targets(f, target);
+    train(&sh->p, f->elapsed, f->rtt, f->cwnd, target);
+    cost_add(sh, t, c);
+    sh->trainings++;
+    sh->p_trained = 1;
+    f->trained = 1;
+    f->pending = 0;
+    f->train_srtt = f->rtt[newest];
+    f->train_cwnd = f->cwnd[newest];
+}
+
+/* the predictor half of bictcp_recalc_ssthresh() */
+static void replay_loss(struct shard *sh, const struct tcp_pred_trace_rec *r)
+{
+    struct flow *f = flow_lookup(sh, r->flow);
+    s64 prediction, target[HIS_LEN];
+    u64 t, c;
+
+    sh->losses++;
+    if (f->pending && r->elapsed > r->srtt >> 3)
+        deferred_train(sh, f);
+    t = now_ns();
+    c = get_cycles();
+    kalman_update(&f->kalman, r->cwnd);
+    if (kalman_mode)
+        cost_add(sh, t, c);
+    t = now_ns();
+    c = get_cycles();
+    holt_update(&f->holt, r->cwnd, r->elapsed);
+    if (holt_mode)
+        cost_add(sh, t, c);
+    if (f->interval && r->elapsed) {
+        sh->interval_scored++;
+        sh->interval_err += fabs((double)f->interval - r->elapsed) / r->elapsed;
+        sh->interval_last_err += fabs((double)f->elapsed_prev - r->elapsed) / r->elapsed;
+        f->interval = 0;
+    }
+    if (f->wmax && r->cwnd) {
+        sh->wmax_scored++;
+        sh->wmax_err += fabs((double)f->wmax - r->cwnd) / r->cwnd;
+        sh->last_err += fabs((double)f->cwnd_prev - r->cwnd) / r->cwnd;
+        score(sh, f, abs((s32)(r->cwnd - f->wmax)) <= (s32)(r->cwnd >> 3));
+        f->wmax = 0;
+    }
+    if (f->ready && f->confidence < min_confidence) {
+        f->confidence = f->confidence + CONF_PROBE > 255 ? 255 : f->confidence + CONF_PROBE;
+        sh->gated++;
+    } else if (f->ready && kalman_mode) {
+        f->wmax = kalman_wmax(&f->kalman, r->cwnd);
+        sh->predictions++;
+    } else if (f->ready && holt_mode) {
+        f->wmax = holt_wmax(&f->holt, r->cwnd);
+        f->interval = holt_interval(&f->holt);
+        sh->predictions++;
+    } else if (f->ready) {
+        t = now_ns();
+        c = get_cycles();
+        if (model == MODEL_MARKOV) {
+            prediction = markov_predict(&f->markov);
+        } else if (model == MODEL_KNN) {
+            flow_targets(f, target);
+            prediction = knn_predict(f->elapsed, f->rtt, f->cwnd, target,
+                                     (f->index + HIS_LEN - 1) % HIS_LEN,
+                                     r->elapsed, r->srtt, r->cwnd);
+        } else if (model == MODEL_LOGISTIC) {
+            prediction = logistic_predict(&sh->lr, r->elapsed, r->srtt, r->cwnd);
+        } else if (model == MODEL_STUMPS) {
+            prediction = stumps_predict(r->elapsed, r->srtt, r->cwnd);
+        } else if (model == MODEL_RNN) {
+            prediction = rnn_predict(&rnn_weights, &f->rnn, r->elapsed, r->srtt, r->cwnd);
+        } else {
+            if (f->pending)
+                sh->batched++;
+            else if (need_train(sh, f, r->srtt, r->cwnd))
+                f->pending = 1;
+            if (model == MODEL_ENSEMBLE)
+                prediction = ensemble_predict(&f->ensemble, &sh->p,
+                                              r->elapsed, r->srtt, r->cwnd);
+            else
+                prediction = get_prediction(&sh->p, r->elapsed, r->srtt, r->cwnd);
+        }
+        cost_add(sh, t, c);
+        sh->predictions++;
+        if (wmax_mode)
+            f->wmax = wmax_from_prediction(r->cwnd, prediction);
+        else
+            score(sh, f, (prediction >= (1 << (GAMMA - 1))) == r->label);
+    }
+    f->cwnd_prev = r->cwnd;
+    f->elapsed_prev = r->elapsed;
+
+    t = now_ns();
+    c = get_cycles();
+    if (model == MODEL_MARKOV)
+        markov_update(&f->markov, r->label);
+    else if (model == MODEL_LOGISTIC)
+        logistic_update(&sh->lr, r->elapsed, r->srtt, r->cwnd, r->label);
+    else if (model == MODEL_RNN)
+        rnn_update(&rnn_weights, &f->rnn, r->elapsed, r->srtt, r->cwnd, r->label);
+    else if (model == MODEL_PERCEPTRON || model == MODEL_ENSEMBLE)
+        norm_update(&sh->p.norm, r->elapsed, r->srtt, r->cwnd);
+    if (model == MODEL_ENSEMBLE)
+        ensemble_update(&f->ensemble, r->label);
+    cost_add(sh, t, c);
+    f->elapsed[f->index] = fixp_u16f_encode(r->elapsed);
+    f->rtt[f->index] = fixp_u16f_encode(r->srtt);
+    f->cwnd[f->index] = fixp_u16f_encode(r->cwnd);
+    f->answers = (f->answers & ~(1U << f->index)) | (r->label & 1U) << f->index;
+    if (++f->index == HIS_LEN) {
+        f->ready = 1;
+        f->index = 0;
+    }
+}
+
+static void *shard_run(void *arg)
+{
+    struct shard *sh = arg;
+    size_t i;
+    int n;
+
+    initialize_perceptron(&sh->p, seed + sh->id);
+    for (n = 0; n < nr_files; n++) {
+        for (i = 0; i < files[n].nr; i++) {
+            const struct tcp_pred_trace_rec *r = &files[n].rec[i];
+
+            if ((flow_hash(r->flow) >> 16) % nr_shards == (u32)sh->id)
+                replay_loss(sh, r);
+        }
+    }
+    return NULL;
+}
+
+static void map_file(struct trace_file *tf, const char *name)
+{
+    struct stat st;
+    void *p;
+    int fd;
+
+    fd = open(name, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        fprintf(stderr, "%s: %s\n", name, strerror(errno));
+        exit(1);
+    }
+    if (st.st_size % sizeof(struct tcp_pred_trace_rec))
+        fprintf(stderr, "%s: trailing partial record ignored\n", name);
+    tf->name = name;
+    tf->nr = st.st_size / sizeof(struct tcp_pred_trace_rec);
+    tf->rec = NULL;
+    if (tf->nr) {
+        p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+            fprintf(stderr, "%s: %s\n", name, strerror(errno));
+            exit(1);
+        }
+        madvise(p, st.st_size, MADV_SEQUENTIAL);
+        tf->rec = p;
+    }
+    close(fd);
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: tcp_pred_replay [-j threads] [-s seed] [-w|-k|-H] [-c min_confidence] [-t]\n"
+            "                       [-m perceptron|markov|knn|logistic|stumps|rnn|ensemble] trace...\n");
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    struct shard *shards;
+    u64 losses = 0, predictions = 0, hits = 0, train_ns = 0, train_cycles = 0, flows = 0, t;
+    u64 wmax_scored = 0, gated = 0, trainings = 0, batched = 0;
+    u64 interval_scored = 0;
+    double wall, wmax_err = 0, last_err = 0, interval_err = 0, interval_last_err = 0;
+    int c, i;
+
+    while ((c = getopt(argc, argv, "j:s:wkHc:tm:")) != -1) {
+        switch (c) {
+        case 'j':
+            nr_shards = atoi(optarg);
+            break;
+        case 's':
+            seed = strtoul(optarg, NULL, 0);
+            break;
+        case 'w':
+            wmax_mode = 1;
+            break;
+        case 'k':
+            wmax_mode = kalman_mode = 1;
+            break;
+        case 'H':
+            wmax_mode = holt_mode = 1;
+            break;
+        case 'c':
+            min_confidence = atoi(optarg);
+            break;
+        case 't':
+            adaptive_train = 0;
+            break;
+        case 'm':
+            for (model = 0; model < (int)(sizeof(model_names) / sizeof(model_names[0])); model++)
+                if (!strcmp(optarg, model_names[model]))
+                    break;
+            if (model == (int)(sizeof(model_names) / sizeof(model_names[0])))
+                usage();
+            break;
+        default:
+            usage();
+        }
+    }
+    if (optind == argc || nr_shards < 1)
+        usage();
+    /* TCP_PRED_MODEL_WMAX in the kernel, the others only predict labels */
+    if (wmax_mode && !kalman_mode && !holt_mode &&
+        model != MODEL_PERCEPTRON && model != MODEL_KNN) {
+        fprintf(stderr, "tcp_pred_replay: -w needs a model that predicts Wmax (perceptron, knn)\n");
+        return 2;
+    }
+
+    nr_files = argc - optind;
+    files = calloc(nr_files, sizeof(*files));
+    shards = calloc(nr_shards, sizeof(*shards));
+    if (!files || !shards) {
+        perror("calloc");
+        return 1;
+    }
+    for (i = 0; i < nr_files; i++)
+        map_file(&files[i], argv[optind + i]);
+
+    t = now_ns();
+    for (i = 0; i < nr_shards; i++) {
+        shards[i].id = i;
+        if (pthread_create(&shards[i].thread, NULL, shard_run, &shards[i])) {
+            perror("pthread_create");
+            return 1;
+        }
+    }
+    for (i = 0; i < nr_shards; i++) {
+        pthread_join(shards[i].thread, NULL);
+        losses += shards[i].losses;
+        predictions += shards[i].predictions;
+        hits += shards[i].hits;
+        train_ns += shards[i].train_ns;
+        train_cycles += shards[i].train_cycles;
+        flows += shards[i].nr_flows;
+        wmax_scored += shards[i].wmax_scored;
+        gated += shards[i].gated;
+        trainings += shards[i].trainings;
+        batched += shards[i].batched;
+        wmax_err += shards[i].wmax_err;
+        last_err += shards[i].last_err;
+        interval_scored += shards[i].interval_scored;
+        interval_err += shards[i].interval_err;
+        interval_last_err += shards[i].interval_last_err;
+    }
+    wall = (now_ns() - t) / 1e9;
+
+    printf("model %s ", kalman_mode ? "kalman" : holt_mode ? "holt" : model_names[model]);
+    printf("losses %llu flows %llu predictions %llu gated %llu trainings %llu batched %llu",
+           (unsigned long long)losses, (unsigned long long)flows,
+           (unsigned long long)predictions, (unsigned long long)gated,
+           (unsigned long long)trainings, (unsigned long long)batched);
+    if (predictions && !wmax_mode)
+        printf(" accuracy %.2f%%", 100.0 * hits / predictions);
+    if (wmax_scored)
+        printf(" wmax error %.2f%% (previous cwnd %.2f%%)",
+               100.0 * wmax_err / wmax_scored, 100.0 * last_err / wmax_scored);
+    if (interval_scored)
+        printf(" interval error %.2f%% (previous interval %.2f%%)",
+               100.0 * interval_err / interval_scored,
+               100.0 * interval_last_err / interval_scored);
+    if (predictions)
+        printf(" train+predict %.0f ns/loss %.0f cycles/loss", (double)train_ns / predictions,
+               (double)train_cycles / predictions);
+    printf("\nwall %.3f s, %.0f losses/s on %d threads\n",
+           wall, wall > 0 ? losses / wall : 0.0, nr_shards);
+    return 0;
+}
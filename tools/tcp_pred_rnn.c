@@ -0,0 +1,380 @@
+/*
+ * tcp_pred_rnn - train the recurrent cell of rnn.h on loss traces and
+ * write its weights as a C header for the "rnn" model
+ *
+ *   tcp_pred_rnn [-e epochs] [-r rate] [-s seed] [-o ../rnn_gen.h] loss.trace...
+ *
+ * The records are split into per-flow sequences in trace order, one per
+ * flow and trace file, and the cell is trained in floating point with
+ * backpropagation through time over windows of BPTT_LEN losses, the
+ * state carried from one window to the next, and Adam. The inputs are
+ * computed by rnn_inputs() itself and the weights are kept within
+ * RNN_W_MAX, so the rounded Q12 weights behave the same; the accuracy
+ * printed is that of the fixed-point cell.
+ */
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "user.h"
+#include "tcp_pred.h"
+/* only sigmoid[] of perceptron.h is used here */
+#pragma GCC diagnostic ignored "-Wunused-function"
+#include "rnn.h"
+
+#define BPTT_LEN 16
+#define H RNN_HIDDEN
+#define X RNN_IN
+
+/* struct rnn_weights in floating point, flattened for Adam */
+struct params {
+    double wh[H][H];
+    double wx[H][X + 1];
+    double bh[H];
+    double wo[H];
+    double wxo[X];
+    double bo;
+};
+#define NR_PARAMS (sizeof(struct params) / sizeof(double))
+
+struct seq {
+    int file;
+    u32 flow;
+    size_t nr, max;
+    struct tcp_pred_trace_rec *rec;
+    double (*x)[X]; /* rnn_inputs() of each loss */
+};
+
+static struct seq *seqs;
+static size_t nr_seqs, max_seqs;
+static size_t nr_losses;
+
+static struct seq *seq_of(int file, u32 flow)
+{
+    size_t i;
+
+    /* a linear scan is fine for the few thousand flows of a trace */
+    for (i = nr_seqs; i > 0; i--)
+        if (seqs[i - 1].file == file && seqs[i - 1].flow == flow)
+            return &seqs[i - 1];
+    if (nr_seqs == max_seqs) {
+        max_seqs = max_seqs ? max_seqs * 2 : 256;
+        seqs = realloc(seqs, max_seqs * sizeof(*seqs));
+        if (!seqs) {
+            perror("realloc");
+            exit(1);
+        }
+    }
+    memset(&seqs[nr_seqs], 0, sizeof(*seqs));
+    seqs[nr_seqs].file = file;
+    seqs[nr_seqs].flow = flow;
+    return &seqs[nr_seqs++];
+}
+
+static void load(int file, const char *name)
+{
+    struct tcp_pred_trace_rec r;
+    FILE *f = fopen(name, "rb");
+    struct seq *s;
+
+    if (!f) {
+        fprintf(stderr, "%s: %s\n", name, strerror(errno));
+        exit(1);
+    }
+    while (fread(&r, sizeof(r), 1, f) == 1) {
+        s = seq_of(file, r.flow);
+        if (s->nr == s->max) {
+            s->max = s->max ? s->max * 2 : 64;
+            s->rec = realloc(s->rec, s->max * sizeof(*s->rec));
+            if (!s->rec) {
+                perror("realloc");
+                exit(1);
+            }
+        }
+        s->rec[s->nr++] = r;
+        nr_losses++;
+    }
+    fclose(f);
+}
+
+static void make_inputs(void)
+{
+    struct rnn_flow fl;
+    s32 x[X];
+    size_t i, t;
+    int k;
+
+    for (i = 0; i < nr_seqs; i++) {
+        struct seq *s = &seqs[i];
+
+        s->x = malloc(s->nr * sizeof(*s->x));
+        if (!s->x) {
+            perror("malloc");
+            exit(1);
+        }
+        memset(&fl, 0, sizeof(fl));
+        for (t = 0; t < s->nr; t++) {
+            rnn_inputs(&fl, x, s->rec[t].elapsed, s->rec[t].srtt, s->rec[t].cwnd);
+            for (k = 0; k < X; k++)
+                s->x[t][k] = (double)x[k] / RNN_ONE;
+            fl.cwnd = fixp_u16f_encode(s->rec[t].cwnd);
+            if (!fl.cwnd)
+                fl.cwnd = 1;
+        }
+    }
+}
+
+static double sigm(double z)
+{
+    return 1 / (1 + exp(-z));
+}
+
+/* forward and backward over one window, the gradient is added to g */
+static double window(const struct params *p, struct params *g, const struct seq *s,
+                     size_t t0, size_t n, double *h0)
+{
+    double h[BPTT_LEN + 1][H], u[BPTT_LEN][X + 1], y[BPTT_LEN];
+    double dh[H], da[H], dprev[H], loss = 0;
+    size_t t;
+    int i, j;
+
+    memcpy(h[0], h0, sizeof(h[0]));
+    for (t = 0; t < n; t++) {
+        const double *x = s->x[t0 + t];
+        double z = p->bo;
+        int label = s->rec[t0 + t].label & 1;
+
+        for (i = 0; i < H; i++)
+            z += p->wo[i] * h[t][i];
+        for (i = 0; i < X; i++)
+            z += p->wxo[i] * x[i];
+        y[t] = sigm(z);
+        loss -= label ? log(y[t] + 1e-12) : log(1 - y[t] + 1e-12);
+
+        for (i = 0; i < X; i++)
+            u[t][i] = x[i];
+        u[t][X] = label ? 1 : -1;
+        for (i = 0; i < H; i++) {
+            double a = p->bh[i];
+
+            for (j = 0; j < H; j++)
+                a += p->wh[i][j] * h[t][j];
+            for (j = 0; j <= X; j++)
+                a += p->wx[i][j] * u[t][j];
+            h[t + 1][i] = tanh(a);
+        }
+    }
+    memcpy(h0, h[n], sizeof(h[0]));
+
+    memset(dh, 0, sizeof(dh));
+    for (t = n; t-- > 0;) {
+        const double *x = s->x[t0 + t];
+        double dz = y[t] - (s->rec[t0 + t].label & 1);
+
+        /* h[t + 1] only feeds later steps, dh holds what they sent back */
+        for (i = 0; i < H; i++)
+            da[i] = dh[i] * (1 - h[t + 1][i] * h[t + 1][i]);
+        for (j = 0; j < H; j++) {
+            dprev[j] = dz * p->wo[j];
+            for (i = 0; i < H; i++)
+                dprev[j] += da[i] * p->wh[i][j];
+        }
+        for (i = 0; i < H; i++) {
+            g->bh[i] += da[i];
+            for (j = 0; j < H; j++)
+                g->wh[i][j] += da[i] * h[t][j];
+            for (j = 0; j <= X; j++)
+                g->wx[i][j] += da[i] * u[t][j];
+            g->wo[i] += dz * h[t][i];
+        }
+        for (i = 0; i < X; i++)
+            g->wxo[i] += dz * x[i];
+        g->bo += dz;
+        memcpy(dh, dprev, sizeof(dh));
+    }
+    return loss;
+}
+
+static void quantize(const struct params *p, struct rnn_weights *w)
+{
+    const double *src = (const double *)p;
+    s32 *dst = (s32 *)w;
+    size_t i;
+
+    for (i = 0; i < NR_PARAMS; i++)
+        dst[i] = lround(src[i] * RNN_ONE);
+}
+
+/* the fixed-point cell over every sequence, as the module runs it */
+static double accuracy(const struct rnn_weights *w)
+{
+    struct rnn_flow fl;
+    size_t i, t, hits = 0;
+
+    for (i = 0; i < nr_seqs; i++) {
+        const struct seq *s = &seqs[i];
+
+        memset(&fl, 0, sizeof(fl));
+        for (t = 0; t < s->nr; t++) {
+            const struct tcp_pred_trace_rec *r = &s->rec[t];
+
+            hits += (rnn_predict(w, &fl, r->elapsed, r->srtt, r->cwnd)
+                     >= (1 << (GAMMA - 1))) == (r->label & 1);
+            rnn_update(w, &fl, r->elapsed, r->srtt, r->cwnd, r->label & 1);
+        }
+    }
+    return 100.0 * hits / nr_losses;
+}
+
+static void print_row(FILE *out, const s32 *v, int n)
+{
+    int i;
+
+    fprintf(out, "{");
+    for (i = 0; i < n; i++)
+        fprintf(out, " %d%s", v[i], i + 1 < n ? "," : " ");
+    fprintf(out, "}");
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: tcp_pred_rnn [-e epochs] [-r rate] [-s seed] [-o header] trace...\n");
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    struct params p, g, m, v;
+    struct rnn_weights w;
+    double *pp = (double *)&p, *gp = (double *)&g, *mp = (double *)&m, *vp = (double *)&v;
+    double rate = 0.001, lr, loss, h0[H], b1t = 1, b2t = 1;
+    const char *out_name = NULL;
+    int epochs = 30, c, e, i;
+    u32 seed = 1;
+    size_t *order, k, t, n, j;
+    FILE *out = stdout;
+
+    while ((c = getopt(argc, argv, "e:r:s:o:")) != -1) {
+        switch (c) {
+        case 'e':
+            epochs = atoi(optarg);
+            break;
+        case 'r':
+            rate = atof(optarg);
+            break;
+        case 's':
+            seed = strtoul(optarg, NULL, 0);
+            break;
+        case 'o':
+            out_name = optarg;
+            break;
+        default:
+            usage();
+        }
+    }
+    if (optind == argc || epochs < 1 || rate <= 0)
+        usage();
+    for (i = optind; i < argc; i++)
+        load(i, argv[i]);
+    if (!nr_losses) {
+        fprintf(stderr, "no losses in the traces\n");
+        return 1;
+    }
+    make_inputs();
+
+    user_srandom(seed);
+    for (k = 0; k < NR_PARAMS; k++)
+        pp[k] = ((double)random32() / 4294967296.0 - 0.5) * 0.5;
+    memset(&m, 0, sizeof(m));
+    memset(&v, 0, sizeof(v));
+    order = malloc(nr_seqs * sizeof(*order));
+    if (!order) {
+        perror("malloc");
+        return 1;
+    }
+    for (k = 0; k < nr_seqs; k++)
+        order[k] = k;
+
+    for (e = 0; e < epochs; e++) {
+        /*
+         * the flows in a new order every epoch and the rate going down to
+         * nothing, or the weights end up fitted to the last flows
+         */
+        for (k = nr_seqs; k > 1; k--) {
+            j = random32() % k;
+            t = order[k - 1];
+            order[k - 1] = order[j];
+            order[j] = t;
+        }
+        lr = rate * (epochs - e) / epochs;
+        loss = 0;
+        for (k = 0; k < nr_seqs; k++) {
+            const struct seq *s = &seqs[order[k]];
+
+            memset(h0, 0, sizeof(h0));
+            for (t = 0; t < s->nr; t += n) {
+                n = s->nr - t < BPTT_LEN ? s->nr - t : BPTT_LEN;
+                memset(&g, 0, sizeof(g));
+                loss += window(&p, &g, s, t, n, h0);
+                /* Adam */
+                b1t *= 0.9;
+                b2t *= 0.999;
+                for (i = 0; i < (int)NR_PARAMS; i++) {
+                    gp[i] /= n;
+                    mp[i] = 0.9 * mp[i] + 0.1 * gp[i];
+                    vp[i] = 0.999 * vp[i] + 0.001 * gp[i] * gp[i];
+                    pp[i] -= lr * (mp[i] / (1 - b1t)) / (sqrt(vp[i] / (1 - b2t)) + 1e-8);
+                    if (pp[i] > (double)RNN_W_MAX / RNN_ONE)
+                        pp[i] = (double)RNN_W_MAX / RNN_ONE;
+                    if (pp[i] < -(double)RNN_W_MAX / RNN_ONE)
+                        pp[i] = -(double)RNN_W_MAX / RNN_ONE;
+                }
+            }
+        }
+        if (e == 0 || (e + 1) % 10 == 0 || e + 1 == epochs) {
+            quantize(&p, &w);
+            fprintf(stderr, "epoch %3d  loss %.4f  accuracy %.2f%%\n",
+                    e + 1, loss / nr_losses, accuracy(&w));
+        }
+    }
+    quantize(&p, &w);
+
+    if (out_name && !(out = fopen(out_name, "w"))) {
+        fprintf(stderr, "%s: %s\n", out_name, strerror(errno));
+        return 1;
+    }
+    fprintf(out, "/*\n * generated by tools/tcp_pred_rnn, do not edit\n *\n");
+    fprintf(out, " *   tcp_pred_rnn -e %d -r %g -s %u", epochs, rate, seed);
+    for (i = optind; i < argc; i++)
+        fprintf(out, " %s", argv[i]);
+    fprintf(out, "\n *\n * %zu losses in %zu flows, training accuracy %.2f%%\n */\n",
+            nr_losses, nr_seqs, accuracy(&w));
+    fprintf(out, "#ifndef _RNN_GEN_H\n#define _RNN_GEN_H\n\n");
+    fprintf(out, "#if RNN_HIDDEN != %d || RNN_IN != %d || RNN_Q != %d\n", H, X, RNN_Q);
+    fprintf(out, "#error \"rnn_gen.h is for another shape of the cell, regenerate it\"\n#endif\n\n");
+    fprintf(out, "static const struct rnn_weights rnn_weights = {\n    .wh  = {");
+    for (i = 0; i < H; i++) {
+        fprintf(out, "\n        ");
+        print_row(out, w.wh[i], H);
+        fprintf(out, ",");
+    }
+    fprintf(out, "\n    },\n    .wx  = {");
+    for (i = 0; i < H; i++) {
+        fprintf(out, "\n        ");
+        print_row(out, w.wx[i], X + 1);
+        fprintf(out, ",");
+    }
+    fprintf(out, "\n    },\n    .bh  = ");
+    print_row(out, w.bh, H);
+    fprintf(out, ",\n    .wo  = ");
+    print_row(out, w.wo, H);
+    fprintf(out, ",\n    .wxo = ");
+    print_row(out, w.wxo, X);
+    fprintf(out, ",\n    .bo  = %d,\n};\n\n#endif /* _RNN_GEN_H */\n", w.bo);
+    if (out != stdout)
+        fclose(out);
+    return 0;
+}
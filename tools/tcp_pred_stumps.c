@@ -0,0 +1,267 @@
+/*
+ * tcp_pred_stumps - train boosted decision stumps on loss traces and
+ * write them out as a C header for the "stumps" model
+ *
+ *   tcp_pred_stumps [-n rounds] [-r rate] [-o ../stumps_gen.h] loss.trace...
+ *
+ * The features are the time since the previous loss in RTTs, as
+ * stumps_rtts() takes it from elapsed and srtt, and cwnd of the trace
+ * records, and the target is the recorded label.
+ * Each round fits one stump (feature < threshold) to the gradient of
+ * the log loss with a Newton step per leaf, scaled by the learning
+ * rate. Thresholds are taken from NR_BINS quantiles of each feature.
+ *
+ * The header is a chain of comparisons adding up a log-odds score in
+ * 1/SCORE_ONE units, the sigmoid[] index scale of perceptron.h, so the
+ * module evaluates it with no multiply and no table but sigmoid[].
+ */
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "user.h"
+#include "tcp_pred.h"
+/* only stumps_rtts() is used here */
+#pragma GCC diagnostic ignored "-Wunused-function"
+#include "stumps.h"
+
+#define NR_FEATURES 2
+#define NR_BINS     64
+#define SCORE_ONE   4096 /* sigmoid[] steps per unit of log-odds */
+#define SCORE_MAX   (8 * SCORE_ONE)
+
+static const char * const feature_names[NR_FEATURES] = { "rtts", "cwnd" };
+
+struct sample {
+    u32 x[NR_FEATURES];
+    u8  bin[NR_FEATURES];
+    u8  label;
+    double f;  /* score so far, log-odds */
+};
+
+struct stump {
+    int feature;
+    u32 threshold;
+    double left, right;  /* added when x < threshold, and otherwise */
+};
+
+static struct sample *samples;
+static size_t nr_samples, max_samples;
+static u32 thresholds[NR_FEATURES][NR_BINS];
+static int nr_thresholds[NR_FEATURES];
+
+static void load(const char *name)
+{
+    struct tcp_pred_trace_rec r;
+    FILE *f = fopen(name, "rb");
+
+    if (!f) {
+        fprintf(stderr, "%s: %s\n", name, strerror(errno));
+        exit(1);
+    }
+    while (fread(&r, sizeof(r), 1, f) == 1) {
+        if (nr_samples == max_samples) {
+            max_samples = max_samples ? max_samples * 2 : 4096;
+            samples = realloc(samples, max_samples * sizeof(*samples));
+            if (!samples) {
+                perror("realloc");
+                exit(1);
+            }
+        }
+        samples[nr_samples].x[0] = stumps_rtts(r.elapsed, r.srtt);
+        samples[nr_samples].x[1] = r.cwnd;
+        samples[nr_samples].label = r.label & 1;
+        nr_samples++;
+    }
+    fclose(f);
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+    u32 x = *(const u32 *)a, y = *(const u32 *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/* distinct quantiles of each feature, bin b holds thresholds[b-1] <= x < thresholds[b] */
+static void make_bins(void)
+{
+    u32 *v = malloc(nr_samples * sizeof(*v));
+    size_t i;
+    int k, b, n;
+
+    if (!v) {
+        perror("malloc");
+        exit(1);
+    }
+    for (k = 0; k < NR_FEATURES; k++) {
+        for (i = 0; i < nr_samples; i++)
+            v[i] = samples[i].x[k];
+        qsort(v, nr_samples, sizeof(*v), cmp_u32);
+        n = 0;
+        for (b = 1; b < NR_BINS; b++) {
+            u32 t = v[nr_samples * b / NR_BINS];
+
+            if (t > v[0] && (!n || t > thresholds[k][n - 1]))
+                thresholds[k][n++] = t;
+        }
+        nr_thresholds[k] = n;
+        for (i = 0; i < nr_samples; i++) {
+            for (b = 0; b < n && samples[i].x[k] >= thresholds[k][b]; b++)
+                ;
+            samples[i].bin[k] = b;
+        }
+    }
+    free(v);
+}
+
+static double leaf(double g, double h)
+{
+    return h > 1e-9 ? g / h : 0;
+}
+
+/* the stump that most reduces the log loss, as a second order step */
+static struct stump fit_stump(void)
+{
+    double g[NR_FEATURES][NR_BINS + 1], h[NR_FEATURES][NR_BINS + 1];
+    double gl, hl, gt = 0, ht = 0, gain, best_gain = -1;
+    struct stump best = { 0, 0, 0, 0 };
+    size_t i;
+    int k, b;
+
+    memset(g, 0, sizeof(g));
+    memset(h, 0, sizeof(h));
+    for (i = 0; i < nr_samples; i++) {
+        double p = 1 / (1 + exp(-samples[i].f));
+
+        for (k = 0; k < NR_FEATURES; k++) {
+            g[k][samples[i].bin[k]] += samples[i].label - p;
+            h[k][samples[i].bin[k]] += p * (1 - p);
+        }
+        gt += samples[i].label - p;
+        ht += p * (1 - p);
+    }
+    for (k = 0; k < NR_FEATURES; k++) {
+        gl = hl = 0;
+        for (b = 0; b < nr_thresholds[k]; b++) {
+            gl += g[k][b];
+            hl += h[k][b];
+            gain = gl * leaf(gl, hl) + (gt - gl) * leaf(gt - gl, ht - hl);
+            if (gain > best_gain) {
+                best_gain = gain;
+                best.feature = k;
+                best.threshold = thresholds[k][b];
+                best.left = leaf(gl, hl);
+                best.right = leaf(gt - gl, ht - hl);
+            }
+        }
+    }
+    return best;
+}
+
+static double accuracy(void)
+{
+    size_t i, hits = 0;
+
+    for (i = 0; i < nr_samples; i++)
+        hits += (samples[i].f >= 0) == samples[i].label;
+    return 100.0 * hits / nr_samples;
+}
+
+static long score_units(double v)
+{
+    long s = lround(v * SCORE_ONE);
+
+    return s > SCORE_MAX ? SCORE_MAX : s < -SCORE_MAX ? -SCORE_MAX : s;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: tcp_pred_stumps [-n rounds] [-r rate] [-o header] trace...\n");
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    struct stump *stumps;
+    const char *out_name = NULL;
+    double rate = 0.3, bias, pos = 0;
+    int rounds = 32, c, i, n;
+    size_t j;
+    FILE *out = stdout;
+
+    while ((c = getopt(argc, argv, "n:r:o:")) != -1) {
+        switch (c) {
+        case 'n':
+            rounds = atoi(optarg);
+            break;
+        case 'r':
+            rate = atof(optarg);
+            break;
+        case 'o':
+            out_name = optarg;
+            break;
+        default:
+            usage();
+        }
+    }
+    if (optind == argc || rounds < 1 || rate <= 0)
+        usage();
+    for (i = optind; i < argc; i++)
+        load(argv[i]);
+    if (!nr_samples) {
+        fprintf(stderr, "no losses in the traces\n");
+        return 1;
+    }
+
+    for (j = 0; j < nr_samples; j++)
+        pos += samples[j].label;
+    pos = (pos + 1) / (nr_samples + 2);
+    bias = log(pos / (1 - pos));
+    for (j = 0; j < nr_samples; j++)
+        samples[j].f = score_units(bias) / (double)SCORE_ONE;
+    make_bins();
+
+    stumps = calloc(rounds, sizeof(*stumps));
+    if (!stumps) {
+        perror("calloc");
+        return 1;
+    }
+    /* the leaves are rounded as they will be in the header, so is the accuracy */
+    for (n = 0; n < rounds; n++) {
+        struct stump s = fit_stump();
+
+        s.left = score_units(rate * s.left) / (double)SCORE_ONE;
+        s.right = score_units(rate * s.right) / (double)SCORE_ONE;
+        stumps[n] = s;
+        for (j = 0; j < nr_samples; j++)
+            samples[j].f += samples[j].x[s.feature] < s.threshold ? s.left : s.right;
+    }
+    fprintf(stderr, "%zu losses, %d stumps, training accuracy %.2f%%\n",
+            nr_samples, rounds, accuracy());
+
+    if (out_name && !(out = fopen(out_name, "w"))) {
+        fprintf(stderr, "%s: %s\n", out_name, strerror(errno));
+        return 1;
+    }
+    fprintf(out, "/*\n * generated by tools/tcp_pred_stumps, do not edit\n *\n");
+    fprintf(out, " *   tcp_pred_stumps -n %d -r %g", rounds, rate);
+    for (i = optind; i < argc; i++)
+        fprintf(out, " %s", argv[i]);
+    fprintf(out, "\n *\n * %zu losses, training accuracy %.2f%%\n */\n", nr_samples, accuracy());
+    fprintf(out, "#ifndef _STUMPS_GEN_H\n#define _STUMPS_GEN_H\n\n");
+    fprintf(out, "#define STUMPS_SCORE_ONE %d\n\n", SCORE_ONE);
+    fprintf(out, "/* log-odds of label 1 in 1/STUMPS_SCORE_ONE */\n");
+    fprintf(out, "static inline s32 stumps_score(u32 rtts, u32 cwnd)\n{\n");
+    fprintf(out, "    s32 s = %ld;\n\n", score_units(bias));
+    for (n = 0; n < rounds; n++)
+        fprintf(out, "    s += %s < %uU ? %ld : %ld;\n", feature_names[stumps[n].feature],
+                stumps[n].threshold, score_units(stumps[n].left), score_units(stumps[n].right));
+    fprintf(out, "    return s;\n}\n\n#endif /* _STUMPS_GEN_H */\n");
+    if (out != stdout)
+        fclose(out);
+    return 0;
+}
@@ -0,0 +1,176 @@
+/*
+ * tcp_pred_synth - write a synthetic loss trace, the training data of
+ * stumps_gen.h and rnn_gen.h
+ *
+ *   tcp_pred_synth [-s seed] [-f flows] [-n losses] [-b] [-z hz] [-o loss.trace]
+ *
+ * Each flow has a saturation cwnd drawn from 30..400 and an srtt from
+ * 10..300 ms. Its losses come at that cwnd swinging by +-15% with a
+ * period of four losses, plus 5% gaussian noise, 200..3000 ms apart.
+ * With -b a loss is followed by up to three more within srtt/8, each
+ * at 0.8 of the cwnd before it, as in a loss storm. The labels are
+ * those of a flow with fast convergence at the default beta.
+ *
+ * Times are in jiffies of a kernel with -z HZ (1000), the same draws
+ * are made whatever HZ, so the traces of two HZ only differ in scale.
+ * The draws depend on the seed alone, a trace is reproduced by running
+ * the command line in the header of the generated file again.
+ */
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "user.h"
+#include "tcp_pred.h"
+
+#define BETA_SCALE 1024
+#define BETA       819   /* net.tcp_pred.beta */
+#define STORM_MAX  3
+
+struct flow {
+    u32 port;
+    u32 w;          /* saturation cwnd */
+    u32 srtt;       /* ms << 3 */
+    u32 time;       /* jiffies */
+    u32 last_max;
+    u32 loss_cwnd;
+};
+
+static u32 hz = 1000;
+static FILE *out;
+
+/* lo..hi, both included */
+static u32 uniform(u32 lo, u32 hi)
+{
+    return lo + random32() % (hi - lo + 1);
+}
+
+static double gauss(double sd)
+{
+    double u = (random32() + 0.5) / 4294967296.0;
+    double v = (random32() + 0.5) / 4294967296.0;
+
+    return sd * sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+}
+
+static u32 jiffies(u32 ms)
+{
+    u32 j = (u64)ms * hz / 1000;
+
+    return j ? j : 1;
+}
+
+static void emit(struct flow *fl, u32 elapsed_ms, u32 cwnd)
+{
+    struct tcp_pred_trace_rec r;
+    u32 elapsed = jiffies(elapsed_ms);
+    s32 srtt = fl->srtt + (s32)uniform(0, 40) - 20;
+
+    fl->time += elapsed;
+    memset(&r, 0, sizeof(r));
+    r.flow = fl->port;
+    r.time = fl->time;
+    r.elapsed = elapsed;
+    r.srtt = jiffies(srtt);
+    r.cwnd = cwnd;
+    r.ssthresh = cwnd * 4 / 5;
+    r.loss_cwnd = fl->loss_cwnd;
+    r.label = cwnd >= fl->last_max;
+    if (fwrite(&r, sizeof(r), 1, out) != 1) {
+        perror("fwrite");
+        exit(1);
+    }
+    fl->last_max = r.label ? cwnd : cwnd * (BETA_SCALE + BETA) / (2 * BETA_SCALE);
+    fl->loss_cwnd = cwnd;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: tcp_pred_synth [-s seed] [-f flows] [-n losses] [-b] [-z hz] [-o trace]\n");
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    struct flow *flows;
+    u32 seed = 1, nr_flows = 64, nr_losses = 400, storm = 0;
+    u32 i, n, k, storms;
+    const char *out_name = NULL;
+    double swing;
+    s32 w;
+    int c;
+
+    while ((c = getopt(argc, argv, "s:f:n:bz:o:")) != -1) {
+        switch (c) {
+        case 's':
+            seed = strtoul(optarg, NULL, 0);
+            break;
+        case 'f':
+            nr_flows = strtoul(optarg, NULL, 0);
+            break;
+        case 'n':
+            nr_losses = strtoul(optarg, NULL, 0);
+            break;
+        case 'b':
+            storm = 1;
+            break;
+        case 'z':
+            hz = strtoul(optarg, NULL, 0);
+            break;
+        case 'o':
+            out_name = optarg;
+            break;
+        default:
+            usage();
+        }
+    }
+    if (optind != argc || !nr_flows || nr_flows > 0x10000 || !hz)
+        usage();
+    out = stdout;
+    if (out_name && !(out = fopen(out_name, "wb"))) {
+        fprintf(stderr, "%s: %s\n", out_name, strerror(errno));
+        return 1;
+    }
+    flows = calloc(nr_flows, sizeof(*flows));
+    if (!flows) {
+        perror("calloc");
+        return 1;
+    }
+
+    user_srandom(seed);
+    for (i = 0; i < nr_flows; i++) {
+        flows[i].port = (10000 + i) << 16 | 80;
+        flows[i].w = uniform(30, 400);
+        flows[i].srtt = uniform(80, 2400);
+    }
+    /* round robin over the flows, the order the records of a trace are in */
+    for (n = 0; n < nr_losses; n++) {
+        swing = 1 + 0.15 * ((n % 4) - 1.5) / 1.5;
+        for (i = 0; i < nr_flows; i++) {
+            struct flow *fl = &flows[i];
+            u32 burst_ms = fl->srtt / 8;
+
+            w = fl->w * swing + gauss(fl->w * 0.05);
+            if (w < 4)
+                w = 4;
+            /* a storm's losses are within srtt/8, the others never */
+            emit(fl, uniform(storm && burst_ms >= 200 ? burst_ms + 1 : 200, 3000), w);
+            storms = storm ? uniform(0, STORM_MAX + 1) : 0;
+            /* 0 twice as often as 1, 2 or 3 */
+            storms = storms ? storms - 1 : 0;
+            for (k = 0; k < storms; k++) {
+                w = w * 4 / 5 < 4 ? 4 : w * 4 / 5;
+                emit(fl, uniform(1, burst_ms ? burst_ms : 1), w);
+            }
+        }
+    }
+    if (out != stdout && fclose(out)) {
+        fprintf(stderr, "%s: %s\n", out_name, strerror(errno));
+        return 1;
+    }
+    free(flows);
+    return 0;
+}
@@ -0,0 +1,91 @@
+/*
+ * userspace stand-ins for the kernel definitions used by the shared
+ * tcp_pred headers
+ *
+ * perceptron.h, fixp.h and the model headers next to tcp_pred.c are
+ * built both into the module and into the tools here, so they must not
+ * call into the kernel: the types and helpers they use (u64..u8, fls(),
+ * int_sqrt(), random32()...) come from the includer, which is
+ * tcp_pred.c or this file.
+ */
+#ifndef _USER_H
+#define _USER_H
+
+#include <stdint.h>
+#include <linux/types.h>
+
+typedef int64_t  s64;
+typedef uint64_t u64;
+typedef int32_t  s32;
+typedef uint32_t u32;
+typedef int16_t  s16;
+typedef uint16_t u16;
+typedef int8_t   s8;
+typedef uint8_t  u8;
+
+static inline int fls(u32 x)
+{
+    return x ? 32 - __builtin_clz(x) : 0;
+}
+
+/* the cycle counter where there is one, else ns */
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+
+static inline u64 get_cycles(void)
+{
+    return __rdtsc();
+}
+#else
+#include <time.h>
+
+static inline u64 get_cycles(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+#endif
+
+/* lib/int_sqrt.c */
+static inline unsigned long int_sqrt(unsigned long x)
+{
+    unsigned long b, m, y = 0;
+
+    if (x <= 1)
+        return x;
+    m = 1UL << (8 * sizeof(long) - 2);
+    while (m > x)
+        m >>= 2;
+    while (m) {
+        b = y + m;
+        y >>= 1;
+        if (x >= b) {
+            x -= b;
+            y += m;
+        }
+        m >>= 2;
+    }
+    return y;
+}
+
+/* per-thread xorshift32 in place of the kernel's random32() */
+static __thread u32 user_random_state = 2463534242U;
+
+static inline void user_srandom(u32 seed)
+{
+    user_random_state = seed ? seed : 2463534242U;
+}
+
+static inline u32 random32(void)
+{
+    u32 x = user_random_state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return user_random_state = x;
+}
+
+#endif /* _USER_H */